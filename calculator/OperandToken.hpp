@@ -1,8 +1,21 @@
 #pragma once
 
+#include <cctype>
+#include <charconv>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
 #include "AbstractToken.hpp"
-#include "sstream"
-#include "string"
+
+// Types that std::from_chars/std::to_chars read and write as numbers; bool
+// and the character types keep going through the stream.
+template <typename T>
+inline constexpr bool kCharconvOperand =
+    std::is_arithmetic_v<T> && !std::is_same_v<T, bool> &&
+    !std::is_same_v<T, char> && !std::is_same_v<T, signed char> &&
+    !std::is_same_v<T, unsigned char>;
 
 template <typename T>
 class OperandToken : public AbstractToken {
@@ -13,21 +26,52 @@ class OperandToken : public AbstractToken {
   const T& GetValue() const { return value_; }
 
  private:
+  static constexpr size_t kMaxLength = 64;
+  // Significant digits of a floating-point result, the stream default.
+  static constexpr int kPrecision = 6;
+
   T value_;
 };
 
 template <typename T>
 OperandToken<T>::OperandToken(const std::string& view) : AbstractToken(view) {
-  std::stringstream stream(view);
-  stream >> value_;
+  if constexpr (kCharconvOperand<T>) {
+    const char* begin = view.data();
+    const char* end = view.data() + view.size();
+    // Leading whitespace and a plus sign are skipped, as operator>> does.
+    while (begin != end && std::isspace(static_cast<unsigned char>(*begin))) {
+      ++begin;
+    }
+    if (begin != end && *begin == '+') {
+      ++begin;
+    }
+    // Zero when nothing parses, as the stream used to leave behind.
+    value_ = T{};
+    std::from_chars(begin, end, value_);
+  } else {
+    std::stringstream stream(view);
+    stream >> value_;
+  }
 }
 
 template <typename T>
 OperandToken<T>::OperandToken(const T& value)
     : AbstractToken(""), value_(value) {
-  std::stringstream stream;
-  stream << value;
-  UpdateStringToken(stream.str());
+  if constexpr (kCharconvOperand<T>) {
+    char buffer[kMaxLength];
+    std::to_chars_result result{};
+    if constexpr (std::is_floating_point_v<T>) {
+      result = std::to_chars(std::begin(buffer), std::end(buffer), value,
+                             std::chars_format::general, kPrecision);
+    } else {
+      result = std::to_chars(std::begin(buffer), std::end(buffer), value);
+    }
+    UpdateStringToken(std::string(std::begin(buffer), result.ptr));
+  } else {
+    std::stringstream stream;
+    stream << value;
+    UpdateStringToken(stream.str());
+  }
 }
 
 template <typename T>
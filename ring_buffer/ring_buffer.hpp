@@ -1,43 +1,910 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <climits>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <span>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// A run of ring slots: `first` starts at the requested position and
+// `second` continues from the beginning of the storage after the wrap.
+template <typename T>
+struct RingSegments {
+  std::span<T> first;
+  std::span<T> second;
+
+  size_t Size() const { return first.size() + second.size(); }
+
+  RingSegments First(size_t count) const {
+    if (count <= first.size()) {
+      return {first.first(count), {}};
+    }
+    return {first, second.first(std::min(count - first.size(), second.size()))};
+  }
+};
+
+namespace internal {
+inline constexpr size_t kCacheLineSize = 64;
+
+template <typename T>
+void CopyElements(const T* from, size_t count, T* to) {
+  if constexpr (std::is_trivially_copyable_v<T>) {
+    if (count != 0) {
+      std::memcpy(to, from, count * sizeof(T));
+    }
+  } else {
+    std::copy_n(from, count, to);
+  }
+}
+
+template <typename T>
+void MoveElements(T* from, size_t count, T* to) {
+  if constexpr (std::is_trivially_copyable_v<T>) {
+    CopyElements(from, count, to);
+  } else {
+    std::move(from, from + count, to);
+  }
+}
+
+template <typename T>
+RingSegments<T> MakeSegments(std::span<T> ring, size_t start, size_t count) {
+  if (count == 0) {
+    return {};
+  }
+  std::span<T> first =
+      ring.subspan(start, std::min(count, ring.size() - start));
+
+  return {first, ring.first(count - first.size())};
+}
+
+template <typename T>
+void CopyInto(std::span<const T> elements, RingSegments<T> slots) {
+  CopyElements(elements.data(), slots.first.size(), slots.first.data());
+  CopyElements(elements.data() + slots.first.size(), slots.second.size(),
+               slots.second.data());
+}
+
+template <typename T>
+void MoveOutOf(RingSegments<T> slots, std::span<T> elements) {
+  MoveElements(slots.first.data(), slots.first.size(), elements.data());
+  MoveElements(slots.second.data(), slots.second.size(),
+               elements.data() + slots.first.size());
+}
+}  // namespace internal
+
+// Capacity policies decide how many slots a buffer gets and how a
+// free-running counter maps onto a slot index.
+class ExactCapacity {
+ public:
+  explicit ExactCapacity(size_t capacity) : capacity_(capacity) {}
+
+  size_t Capacity() const { return capacity_; }
+
+  size_t Wrap(size_t index) const { return index % capacity_; }
+
+ private:
+  size_t capacity_;
+};
+
+// Rounds the capacity up to a power of two so that wrapping is a bitmask
+// instead of an integer division.
+class PowerOfTwoCapacity {
+ public:
+  explicit PowerOfTwoCapacity(size_t capacity)
+      : mask_(std::bit_ceil(capacity) - 1) {}
+
+  size_t Capacity() const { return mask_ + 1; }
+
+  size_t Wrap(size_t index) const { return index & mask_; }
+
+ private:
+  size_t mask_;
+};
+
+// Storages own the slots and know how a run of them is laid out in memory.
+template <typename T>
+class VectorStorage {
+ public:
+  explicit VectorStorage(size_t capacity) : values_(capacity) {}
+
+  size_t Capacity() const { return values_.size(); }
+
+  T& operator[](size_t index) { return values_[index]; }
+
+  RingSegments<T> Segments(size_t start, size_t count) {
+    return internal::MakeSegments(std::span<T>(values_), start, count);
+  }
+
+ private:
+  std::vector<T> values_;
+};
+
+#ifdef __linux__
+// Maps the same memfd pages twice, back to back, so a run that crosses the
+// end of the ring continues seamlessly into the second mapping: every
+// segment pair has an empty `second`. The capacity is rounded up to whole
+// pages, or to whole elements for elements larger than a page, which keeps
+// power-of-two capacities powers of two.
+template <typename T>
+class MirroredStorage {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "mirrored slots are aliased and cannot own resources");
+  static_assert(std::has_single_bit(sizeof(T)),
+                "element size must divide the page size or be a multiple "
+                "of it");
+
+ public:
+  explicit MirroredStorage(size_t capacity);
+  MirroredStorage(const MirroredStorage&) = delete;
+  MirroredStorage& operator=(const MirroredStorage&) = delete;
+  ~MirroredStorage();
+
+  size_t Capacity() const { return capacity_; }
+
+  T& operator[](size_t index) { return data_[index]; }
+
+  RingSegments<T> Segments(size_t start, size_t count) {
+    return {std::span<T>(data_ + start, count), {}};
+  }
+
+ private:
+  T* data_ = nullptr;
+  size_t capacity_ = 0;
+
+  size_t Bytes() const { return capacity_ * sizeof(T); }
+};
+
+namespace internal {
+[[noreturn]] inline void ThrowSystemError(const char* what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+inline void* MapMirrored(int descriptor, size_t bytes) {
+  void* reserved =
+      mmap(nullptr, 2 * bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (reserved == MAP_FAILED) {
+    ThrowSystemError("mmap");
+  }
+
+  auto* base = static_cast<char*>(reserved);
+  for (char* half : {base, base + bytes}) {
+    if (mmap(half, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+             descriptor, 0) == MAP_FAILED) {
+      munmap(reserved, 2 * bytes);
+      ThrowSystemError("mmap");
+    }
+  }
+
+  return reserved;
+}
+}  // namespace internal
+
+template <typename T>
+MirroredStorage<T>::MirroredStorage(size_t capacity) {
+  auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  // Both sizes are powers of two, so the larger is a multiple of the other
+  // and a whole number of granules is a whole number of pages.
+  size_t granule = std::max(page, sizeof(T)) / sizeof(T);
+  capacity_ = (capacity + granule - 1) / granule * granule;
+  if (capacity_ == 0) {
+    return;
+  }
+
+  int descriptor = memfd_create("ring_buffer", MFD_CLOEXEC);
+  if (descriptor < 0) {
+    internal::ThrowSystemError("memfd_create");
+  }
+  try {
+    if (ftruncate(descriptor, static_cast<off_t>(Bytes())) != 0) {
+      internal::ThrowSystemError("ftruncate");
+    }
+    data_ = static_cast<T*>(internal::MapMirrored(descriptor, Bytes()));
+  } catch (...) {
+    close(descriptor);
+    throw;
+  }
+  close(descriptor);
+}
+
+template <typename T>
+MirroredStorage<T>::~MirroredStorage() {
+  if (data_ != nullptr) {
+    munmap(data_, 2 * Bytes());
+  }
+}
+#endif
+
+template <typename T = int, typename CapacityPolicy = ExactCapacity,
+          template <typename> class Storage = VectorStorage>
 class RingBuffer {
  public:
-  explicit RingBuffer(size_t capacity) { values_.resize(capacity); }
+  explicit RingBuffer(size_t capacity)
+      : storage_(CapacityPolicy(capacity).Capacity()),
+        policy_(storage_.Capacity()) {}
 
-  size_t Size() const { return size_; }
+  size_t Size() const { return tail_ - head_; }
+
+  size_t Capacity() const { return storage_.Capacity(); }
 
   bool Empty() const { return Size() == 0; }
 
-  bool TryPush(int element) {
-    if ((!Empty()) && (begin_ == end_)) {
+  bool TryPush(const T& element) { return TryEmplace(element); }
+
+  bool TryPush(T&& element) { return TryEmplace(std::move(element)); }
+
+  bool TryPop(T* element) {
+    if (Empty()) {
       return false;
     }
 
-    values_[end_] = element;
-    end_ = GetFixedIndex(end_ + 1);
-    size_ += 1;
+    *element = std::move(storage_[policy_.Wrap(head_)]);
+    ++head_;
 
     return true;
   }
 
-  bool TryPop(int* element) {
-    if (Empty()) {
+  // Pushes as many leading elements as fit and returns their number.
+  size_t TryPushN(std::span<const T> elements) {
+    RingSegments<T> slots = Reserve(elements.size());
+    internal::CopyInto(elements, slots);
+    Commit(slots.Size());
+
+    return slots.Size();
+  }
+
+  // Pops up to `elements.size()` elements and returns their number.
+  size_t TryPopN(std::span<T> elements) {
+    RingSegments<T> slots = Peek().First(elements.size());
+    internal::MoveOutOf(slots, elements);
+    Release(slots.Size());
+
+    return slots.Size();
+  }
+
+  // Two-phase push: up to `count` free slots are handed out for writing in
+  // place and become visible to TryPop/Peek only after Commit.
+  RingSegments<T> Reserve(size_t count) {
+    return storage_.Segments(Wrap(tail_), std::min(count, Capacity() - Size()));
+  }
+
+  void Commit(size_t count) { tail_ += count; }
+
+  // Two-phase pop: every stored element, oldest first. Release(count)
+  // drops the first `count` of them.
+  RingSegments<T> Peek() { return storage_.Segments(Wrap(head_), Size()); }
+
+  void Release(size_t count) { head_ += count; }
+
+ private:
+  Storage<T> storage_;
+  CapacityPolicy policy_;
+  size_t head_ = 0;
+  size_t tail_ = 0;
+
+  size_t Wrap(size_t index) const {
+    return Capacity() == 0 ? 0 : policy_.Wrap(index);
+  }
+
+  template <typename U>
+  bool TryEmplace(U&& element) {
+    if (Size() == Capacity()) {
+      return false;
+    }
+
+    storage_[policy_.Wrap(tail_)] = std::forward<U>(element);
+    ++tail_;
+
+    return true;
+  }
+};
+
+namespace internal {
+using Deadline = std::chrono::steady_clock::time_point;
+
+inline constexpr int kSpinIterations = 64;
+inline constexpr int kYieldIterations = 16;
+
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+// A wait queue in one futex word. Waiters announce themselves in `waiters_`
+// before their final check, so Notify costs one fence and one load while
+// nobody sleeps and issues a wake-up syscall only when somebody does.
+class Parker {
+ public:
+  uint32_t Prepare() {
+    uint32_t epoch = epoch_.load(std::memory_order_acquire);
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    // Pairs with the fence in Notify: either the retried attempt sees the
+    // notifier's update or the notifier sees this waiter.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return epoch;
+  }
+
+  void Cancel() { waiters_.fetch_sub(1, std::memory_order_relaxed); }
+
+  // Sleeps until Notify moves the epoch past `epoch`. Returns false when
+  // `deadline` (if any) passes first.
+  bool Park(uint32_t epoch, const Deadline* deadline);
+
+  void Notify() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load(std::memory_order_relaxed) == 0) {
+      return;
+    }
+    epoch_.fetch_add(1, std::memory_order_release);
+#ifdef __linux__
+    syscall(SYS_futex, &epoch_, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr,
+            0);
+#else
+    epoch_.notify_all();
+#endif
+  }
+
+ private:
+  std::atomic<uint32_t> epoch_ = 0;
+  std::atomic<uint32_t> waiters_ = 0;
+};
+
+#ifdef __linux__
+inline bool Parker::Park(uint32_t epoch, const Deadline* deadline) {
+  timespec absolute{};
+  if (deadline != nullptr) {
+    auto since_epoch = deadline->time_since_epoch();
+    auto seconds = std::chrono::floor<std::chrono::seconds>(since_epoch);
+    absolute.tv_sec = seconds.count();
+    absolute.tv_nsec = std::chrono::nanoseconds(since_epoch - seconds).count();
+  }
+  // steady_clock is CLOCK_MONOTONIC, the clock FUTEX_WAIT_BITSET expects.
+  long result = syscall(SYS_futex, &epoch_, FUTEX_WAIT_BITSET_PRIVATE, epoch,
+                        deadline != nullptr ? &absolute : nullptr, nullptr,
+                        FUTEX_BITSET_MATCH_ANY);
+
+  return result == 0 || errno != ETIMEDOUT;
+}
+#else
+inline bool Parker::Park(uint32_t epoch, const Deadline* deadline) {
+  if (deadline == nullptr) {
+    epoch_.wait(epoch, std::memory_order_acquire);
+    return true;
+  }
+  std::this_thread::yield();
+  return std::chrono::steady_clock::now() < *deadline;
+}
+#endif
+
+// Retries `attempt` with a short busy spin, then by yielding, and finally
+// by parking on `parker` until it succeeds or `deadline` passes.
+template <typename Attempt>
+bool Await(Parker& parker, Attempt attempt, const Deadline* deadline) {
+  for (int i = 0; i < kSpinIterations; ++i) {
+    if (attempt()) {
+      return true;
+    }
+    CpuRelax();
+  }
+  for (int i = 0; i < kYieldIterations; ++i) {
+    if (attempt()) {
+      return true;
+    }
+    std::this_thread::yield();
+  }
+
+  while (true) {
+    uint32_t epoch = parker.Prepare();
+    if (attempt()) {
+      parker.Cancel();
+      return true;
+    }
+    bool woken = parker.Park(epoch, deadline);
+    parker.Cancel();
+    if (!woken) {
+      return attempt();
+    }
+  }
+}
+
+template <typename Rep, typename Period>
+Deadline DeadlineAfter(const std::chrono::duration<Rep, Period>& timeout) {
+  return std::chrono::steady_clock::now() +
+         std::chrono::ceil<std::chrono::steady_clock::duration>(timeout);
+}
+
+// Blocking Push/Pop and their timed variants on top of the derived queue's
+// TryPush/TryPop. The derived queue calls NotifyPushed/NotifyPopped after
+// publishing an update.
+template <typename Derived, typename T>
+class BlockingQueue {
+ public:
+  void Push(const T& element) {
+    Await(not_full_, [&] { return Self().TryPush(element); }, nullptr);
+  }
+
+  void Push(T&& element) {
+    Await(not_full_, [&] { return Self().TryPush(std::move(element)); },
+          nullptr);
+  }
+
+  void Pop(T* element) {
+    Await(not_empty_, [&] { return Self().TryPop(element); }, nullptr);
+  }
+
+  template <typename Rep, typename Period>
+  bool PushFor(const T& element,
+               const std::chrono::duration<Rep, Period>& timeout) {
+    Deadline deadline = DeadlineAfter(timeout);
+    return Await(not_full_, [&] { return Self().TryPush(element); },
+                 &deadline);
+  }
+
+  template <typename Rep, typename Period>
+  bool PushFor(T&& element, const std::chrono::duration<Rep, Period>& timeout) {
+    Deadline deadline = DeadlineAfter(timeout);
+    return Await(not_full_,
+                 [&] { return Self().TryPush(std::move(element)); }, &deadline);
+  }
+
+  template <typename Rep, typename Period>
+  bool PopFor(T* element, const std::chrono::duration<Rep, Period>& timeout) {
+    Deadline deadline = DeadlineAfter(timeout);
+    return Await(not_empty_, [&] { return Self().TryPop(element); },
+                 &deadline);
+  }
+
+ protected:
+  void NotifyPushed() { not_empty_.Notify(); }
+
+  void NotifyPopped() { not_full_.Notify(); }
+
+ private:
+  alignas(kCacheLineSize) Parker not_empty_;
+  alignas(kCacheLineSize) Parker not_full_;
+
+  Derived& Self() { return static_cast<Derived&>(*this); }
+};
+
+class NoWaiting {
+ protected:
+  void NotifyPushed() {}
+
+  void NotifyPopped() {}
+};
+}  // namespace internal
+
+// Waiting policies of SpscRingBuffer and MpmcRingBuffer. NonBlocking queues
+// offer only the Try* API, which then never fences. Blocking ones add
+// Push/Pop and their timed variants, and every successful update pays a
+// fence and a load to look for sleeping threads.
+struct NonBlocking {
+  template <typename Derived, typename T>
+  using Base = internal::NoWaiting;
+};
+
+struct Blocking {
+  template <typename Derived, typename T>
+  using Base = internal::BlockingQueue<Derived, T>;
+};
+
+// Lock-free queue for exactly one producer thread and one consumer thread.
+// Head and tail are free-running counters, each side keeps a cached copy of
+// the other side's counter so the shared cache line is touched only when the
+// cached value says the queue looks full (or empty).
+template <typename T = int, typename CapacityPolicy = ExactCapacity,
+          template <typename> class Storage = VectorStorage,
+          typename WaitPolicy = NonBlocking>
+class SpscRingBuffer
+    : public WaitPolicy::template Base<
+          SpscRingBuffer<T, CapacityPolicy, Storage, WaitPolicy>, T> {
+ public:
+  explicit SpscRingBuffer(size_t capacity)
+      : storage_(CapacityPolicy(capacity).Capacity()),
+        policy_(storage_.Capacity()) {}
+
+  SpscRingBuffer(const SpscRingBuffer&) = delete;
+  SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+  size_t Size() const {
+    size_t head = consumer_.head.load(std::memory_order_acquire);
+    size_t tail = producer_.tail.load(std::memory_order_acquire);
+    size_t size = tail - head;
+
+    return size < Capacity() ? size : Capacity();
+  }
+
+  size_t Capacity() const { return storage_.Capacity(); }
+
+  bool Empty() const { return Size() == 0; }
+
+  bool TryPush(const T& element) { return TryEmplace(element); }
+
+  bool TryPush(T&& element) { return TryEmplace(std::move(element)); }
+
+  bool TryPop(T* element) {
+    size_t head = consumer_.head.load(std::memory_order_relaxed);
+    if (Readable(head, 1) == 0) {
       return false;
     }
 
-    *element = values_[begin_];
-    begin_ = GetFixedIndex(begin_ + 1);
-    size_ -= 1;
+    *element = std::move(storage_[policy_.Wrap(head)]);
+    consumer_.head.store(head + 1, std::memory_order_release);
+    this->NotifyPopped();
 
     return true;
   }
 
+  size_t TryPushN(std::span<const T> elements) {
+    RingSegments<T> slots = Reserve(elements.size());
+    internal::CopyInto(elements, slots);
+    Commit(slots.Size());
+
+    return slots.Size();
+  }
+
+  size_t TryPopN(std::span<T> elements) {
+    RingSegments<T> slots = Peek().First(elements.size());
+    internal::MoveOutOf(slots, elements);
+    Release(slots.Size());
+
+    return slots.Size();
+  }
+
+  // Producer side of the two-phase API, see RingBuffer::Reserve.
+  RingSegments<T> Reserve(size_t count) {
+    size_t tail = producer_.tail.load(std::memory_order_relaxed);
+    count = std::min(count, Writable(tail, count));
+
+    return storage_.Segments(Wrap(tail), count);
+  }
+
+  void Commit(size_t count) {
+    size_t tail = producer_.tail.load(std::memory_order_relaxed);
+    producer_.tail.store(tail + count, std::memory_order_release);
+    this->NotifyPushed();
+  }
+
+  // Consumer side of the two-phase API, see RingBuffer::Peek.
+  RingSegments<T> Peek() {
+    size_t head = consumer_.head.load(std::memory_order_relaxed);
+    size_t count = Readable(head, Capacity());
+
+    return storage_.Segments(Wrap(head), count);
+  }
+
+  void Release(size_t count) {
+    size_t head = consumer_.head.load(std::memory_order_relaxed);
+    consumer_.head.store(head + count, std::memory_order_release);
+    this->NotifyPopped();
+  }
+
  private:
-  std::vector<int> values_;
-  size_t begin_ = 0;
-  size_t end_ = 0;
-  size_t size_ = 0;
+  struct alignas(internal::kCacheLineSize) ProducerSide {
+    std::atomic<size_t> tail = 0;
+    size_t cached_head = 0;
+  };
+
+  struct alignas(internal::kCacheLineSize) ConsumerSide {
+    std::atomic<size_t> head = 0;
+    size_t cached_tail = 0;
+  };
+
+  Storage<T> storage_;
+  CapacityPolicy policy_;
+  ProducerSide producer_;
+  ConsumerSide consumer_;
+
+  size_t Wrap(size_t index) const {
+    return Capacity() == 0 ? 0 : policy_.Wrap(index);
+  }
+
+  template <typename U>
+  bool TryEmplace(U&& element) {
+    size_t tail = producer_.tail.load(std::memory_order_relaxed);
+    if (Writable(tail, 1) == 0) {
+      return false;
+    }
+
+    storage_[policy_.Wrap(tail)] = std::forward<U>(element);
+    producer_.tail.store(tail + 1, std::memory_order_release);
+    this->NotifyPushed();
+
+    return true;
+  }
+
+  // Free slots seen by the producer. The consumer's counter is re-read only
+  // when the cached copy does not promise `wanted` slots.
+  size_t Writable(size_t tail, size_t wanted) {
+    size_t free = Capacity() - (tail - producer_.cached_head);
+    if (free < wanted) {
+      producer_.cached_head = consumer_.head.load(std::memory_order_acquire);
+      free = Capacity() - (tail - producer_.cached_head);
+    }
+    return free;
+  }
+
+  size_t Readable(size_t head, size_t wanted) {
+    size_t ready = consumer_.cached_tail - head;
+    if (ready < wanted) {
+      consumer_.cached_tail = producer_.tail.load(std::memory_order_acquire);
+      ready = consumer_.cached_tail - head;
+    }
+    return ready;
+  }
+};
+
+// Bounded queue for any number of producers and consumers (D. Vyukov's
+// algorithm). Every slot carries a sequence number telling which ticket may
+// touch it next, so threads only race on the CAS over the shared ticket.
+// Sequences advance by two per lap to keep a single-slot queue unambiguous.
+template <typename T = int, typename CapacityPolicy = ExactCapacity,
+          typename WaitPolicy = NonBlocking>
+class MpmcRingBuffer
+    : public WaitPolicy::template Base<
+          MpmcRingBuffer<T, CapacityPolicy, WaitPolicy>, T> {
+ public:
+  explicit MpmcRingBuffer(size_t capacity)
+      : policy_(capacity), slots_(policy_.Capacity()) {
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      slots_[i].sequence.store(2 * i, std::memory_order_relaxed);
+    }
+  }
+
+  MpmcRingBuffer(const MpmcRingBuffer&) = delete;
+  MpmcRingBuffer& operator=(const MpmcRingBuffer&) = delete;
+
+  size_t Size() const {
+    size_t head = dequeue_pos_.load(std::memory_order_acquire);
+    size_t tail = enqueue_pos_.load(std::memory_order_acquire);
+    size_t size = tail > head ? tail - head : 0;
+
+    return size < slots_.size() ? size : slots_.size();
+  }
+
+  bool Empty() const { return Size() == 0; }
+
+  size_t Capacity() const { return slots_.size(); }
+
+  bool TryPush(const T& element) { return TryEmplace(element); }
+
+  bool TryPush(T&& element) { return TryEmplace(std::move(element)); }
+
+  bool TryPop(T* element) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    Slot* slot = Acquire(dequeue_pos_, pos, 1);
+    if (slot == nullptr) {
+      return false;
+    }
+
+    *element = std::move(slot->value);
+    slot->sequence.store(2 * (pos + slots_.size()), std::memory_order_release);
+    this->NotifyPopped();
 
-  size_t GetFixedIndex(size_t index) const { return index % values_.size(); }
+    return true;
+  }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> sequence = 0;
+    T value{};
+  };
+
+  CapacityPolicy policy_;
+  std::vector<Slot> slots_;
+  alignas(internal::kCacheLineSize) std::atomic<size_t> enqueue_pos_ = 0;
+  alignas(internal::kCacheLineSize) std::atomic<size_t> dequeue_pos_ = 0;
+
+  template <typename U>
+  bool TryEmplace(U&& element) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Slot* slot = Acquire(enqueue_pos_, pos, 0);
+    if (slot == nullptr) {
+      return false;
+    }
+
+    slot->value = std::forward<U>(element);
+    slot->sequence.store(2 * pos + 1, std::memory_order_release);
+    this->NotifyPushed();
+
+    return true;
+  }
+
+  // Claims ticket `pos` on `counter` once its slot reaches sequence
+  // 2 * pos + phase. Returns nullptr when the slot is a lap behind, which
+  // means the queue is full (phase 0) or empty (phase 1).
+  Slot* Acquire(std::atomic<size_t>& counter, size_t& pos, size_t phase) {
+    if (slots_.empty()) {
+      return nullptr;
+    }
+    while (true) {
+      Slot& slot = slots_[policy_.Wrap(pos)];
+      size_t expected = 2 * pos + phase;
+      size_t sequence = slot.sequence.load(std::memory_order_acquire);
+      if (sequence == expected) {
+        if (counter.compare_exchange_weak(pos, pos + 1,
+                                          std::memory_order_relaxed)) {
+          return &slot;
+        }
+      } else if (static_cast<ptrdiff_t>(sequence - expected) < 0) {
+        return nullptr;
+      } else {
+        pos = counter.load(std::memory_order_relaxed);
+      }
+    }
+  }
+};
+
+template <typename T = int, typename CapacityPolicy = ExactCapacity,
+          template <typename> class Storage = VectorStorage>
+using BlockingSpscRingBuffer =
+    SpscRingBuffer<T, CapacityPolicy, Storage, Blocking>;
+
+template <typename T = int, typename CapacityPolicy = ExactCapacity>
+using BlockingMpmcRingBuffer = MpmcRingBuffer<T, CapacityPolicy, Blocking>;
+
+// Lossy telemetry ring for one writer and any number of readers. Push never
+// fails: once the ring is full it overwrites the oldest entry. Every slot is
+// guarded by its own seqlock, so readers validate what they copied instead
+// of locking and the writer never waits for them.
+template <typename T, typename CapacityPolicy = ExactCapacity>
+class OverwritingRingBuffer {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "readers copy slots that may be overwritten concurrently");
+
+ public:
+  explicit OverwritingRingBuffer(size_t capacity)
+      : policy_(capacity), slots_(policy_.Capacity()) {}
+
+  OverwritingRingBuffer(const OverwritingRingBuffer&) = delete;
+  OverwritingRingBuffer& operator=(const OverwritingRingBuffer&) = delete;
+
+  size_t Capacity() const { return slots_.size(); }
+
+  // Number of entries ever pushed.
+  size_t Written() const { return written_.load(std::memory_order_acquire); }
+
+  size_t Size() const { return std::min(Written(), Capacity()); }
+
+  // Number of entries overwritten before anybody could be sure to see them.
+  size_t Dropped() const {
+    size_t written = Written();
+    return written - std::min(written, Capacity());
+  }
+
+  // Writer side, must not be called concurrently with itself.
+  void Push(const T& element) {
+    size_t pos = written_.load(std::memory_order_relaxed);
+    if (slots_.empty()) {
+      written_.store(pos + 1, std::memory_order_release);
+      return;
+    }
+
+    Slot& slot = slots_[policy_.Wrap(pos)];
+    slot.sequence.store(2 * pos + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&slot.value, &element, sizeof(T));
+    slot.sequence.store(2 * pos + 2, std::memory_order_release);
+    written_.store(pos + 1, std::memory_order_release);
+  }
+
+  // Copies up to `elements.size()` of the newest entries, oldest first, and
+  // returns how many were copied. Entries overwritten while being read are
+  // left out together with everything older than them.
+  size_t Snapshot(std::span<T> elements) const {
+    size_t end = Written();
+    size_t count = std::min({elements.size(), end, Capacity()});
+    size_t copied = 0;
+    for (size_t pos = end - count; pos < end; ++pos) {
+      if (TryRead(pos, &elements[copied])) {
+        ++copied;
+      } else {
+        copied = 0;
+      }
+    }
+
+    return copied;
+  }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> sequence = 0;
+    T value{};
+  };
+
+  CapacityPolicy policy_;
+  std::vector<Slot> slots_;
+  alignas(internal::kCacheLineSize) std::atomic<size_t> written_ = 0;
+
+  bool TryRead(size_t pos, T* element) const {
+    const Slot& slot = slots_[policy_.Wrap(pos)];
+    size_t before = slot.sequence.load(std::memory_order_acquire);
+    if (before != 2 * pos + 2) {
+      return false;
+    }
+    std::memcpy(element, &slot.value, sizeof(T));
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    return slot.sequence.load(std::memory_order_relaxed) == before;
+  }
+};
+
+enum class ShrinkPolicy { kNever, kHysteresis };
+
+// Unbounded FIFO on top of RingBuffer: a push into a full ring unwraps the
+// contents into a ring twice as large, which keeps pushes amortised O(1).
+// With ShrinkPolicy::kHysteresis the ring is halved once it drains to a
+// quarter, never below the initial capacity, so memory comes back after a
+// burst without reallocating on every push/pop around a boundary.
+template <typename T = int, typename CapacityPolicy = ExactCapacity>
+class GrowableRingBuffer {
+ public:
+  explicit GrowableRingBuffer(size_t capacity,
+                              ShrinkPolicy shrink = ShrinkPolicy::kNever)
+      : buffer_(capacity), min_capacity_(buffer_.Capacity()), shrink_(shrink) {}
+
+  size_t Size() const { return buffer_.Size(); }
+
+  size_t Capacity() const { return buffer_.Capacity(); }
+
+  bool Empty() const { return buffer_.Empty(); }
+
+  void Push(const T& element) { Emplace(element); }
+
+  void Push(T&& element) { Emplace(std::move(element)); }
+
+  bool TryPop(T* element) {
+    if (!buffer_.TryPop(element)) {
+      return false;
+    }
+
+    if (shrink_ == ShrinkPolicy::kHysteresis &&
+        Capacity() / 2 >= min_capacity_ &&
+        Size() <= Capacity() / kShrinkFraction) {
+      Reallocate(Capacity() / 2);
+    }
+
+    return true;
+  }
+
+ private:
+  static constexpr size_t kShrinkFraction = 4;
+
+  RingBuffer<T, CapacityPolicy> buffer_;
+  size_t min_capacity_;
+  ShrinkPolicy shrink_;
+
+  template <typename U>
+  void Emplace(U&& element) {
+    if (Size() == Capacity()) {
+      Reallocate(std::max<size_t>(2 * Capacity(), 1));
+    }
+    buffer_.TryPush(std::forward<U>(element));
+  }
+
+  void Reallocate(size_t capacity) {
+    RingBuffer<T, CapacityPolicy> resized(capacity);
+    RingSegments<T> stored = buffer_.Peek();
+    RingSegments<T> slots = resized.Reserve(stored.Size());
+
+    internal::MoveOutOf(stored, slots.first);
+    resized.Commit(stored.Size());
+    buffer_ = std::move(resized);
+  }
 };
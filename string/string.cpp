@@ -1,10 +1,24 @@
 #include "string.hpp"
 
-namespace entrails {
-size_t Max(size_t lhs, size_t rhs) { return lhs > rhs ? lhs : rhs; }
-
-size_t Min(size_t lhs, size_t rhs) { return lhs > rhs ? rhs : lhs; }
+#include <locale.h>
+#include <sys/uio.h>
+
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <system_error>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#endif
 
+namespace entrails {
 bool Isspace(char symbol) {
   switch (symbol) {
     case '\n':
@@ -18,297 +32,1415 @@ bool Isspace(char symbol) {
       return false;
   }
 }
-}  // namespace entrails
 
-String::String(size_t size, char character)
-    : size_(size), capacity_(size + 1), characters_(new char[capacity_]) {
-  for (size_t i = 0; i < size_; ++i) {
-    characters_[i] = character;
+static constexpr size_t kShortNeedle = 32;
+
+// Candidates come from memchr on the first byte and are checked with memcmp.
+size_t FindByFirstByte(StringView hay, StringView needle) {
+  size_t from = 0;
+  while (from + needle.Size() <= hay.Size()) {
+    const void* first = std::memchr(hay.Data() + from, needle[0],
+                                    hay.Size() - needle.Size() + 1 - from);
+    if (first == nullptr) {
+      break;
+    }
+    from = static_cast<const char*>(first) - hay.Data();
+    if (std::memcmp(hay.Data() + from, needle.Data(), needle.Size()) == 0) {
+      return from;
+    }
+    ++from;
   }
-  SetNullSymbol(size_);
+  return kNotFound;
 }
 
-String::String(const char* raw_string)
-    : size_(std::strlen(raw_string)),
-      capacity_(size_ + 1),
-      characters_(new char[capacity_]) {
-  for (size_t i = 0; i < size_; ++i) {
-    characters_[i] = raw_string[i];
-  }
-  SetNullSymbol(size_);
+#ifdef __SSE2__
+static constexpr size_t kVectorSize = sizeof(__m128i);
+
+__m128i LoadVector(const char* data) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
 }
 
-String::~String() { delete[] characters_; }
+// Compares kVectorSize positions at once against the first and the last
+// byte of the needle and memcmp's only those where both agree.
+size_t FindShort(StringView hay, StringView needle) {
+  size_t last = needle.Size() - 1;
+  const __m128i first_byte = _mm_set1_epi8(needle[0]);
+  const __m128i last_byte = _mm_set1_epi8(needle[last]);
+  size_t pos = 0;
+  for (; pos + last + kVectorSize <= hay.Size(); pos += kVectorSize) {
+    __m128i first_equal =
+        _mm_cmpeq_epi8(first_byte, LoadVector(hay.Data() + pos));
+    __m128i last_equal =
+        _mm_cmpeq_epi8(last_byte, LoadVector(hay.Data() + pos + last));
+    auto mask = static_cast<unsigned>(
+        _mm_movemask_epi8(_mm_and_si128(first_equal, last_equal)));
+    for (; mask != 0; mask &= mask - 1) {
+      size_t candidate = pos + std::countr_zero(mask);
+      if (std::memcmp(hay.Data() + candidate + 1, needle.Data() + 1,
+                      last - 1) == 0) {
+        return candidate;
+      }
+    }
+  }
 
-String::String(const String& other)
-    : size_(other.size_),
-      capacity_(other.capacity_),
-      characters_(new char[other.capacity_]) {
-  for (size_t i = 0; i < other.size_; ++i) {
-    characters_[i] = other[i];
+  size_t found =
+      FindByFirstByte({hay.Data() + pos, hay.Size() - pos}, needle);
+  return found == kNotFound ? kNotFound : pos + found;
+}
+#else
+size_t FindShort(StringView hay, StringView needle) {
+  return FindByFirstByte(hay, needle);
+}
+#endif
+
+// Two-Way string matching (Crochemore and Perrin): linear time and constant
+// space. MaximalSuffix returns the start of the maximal suffix of `needle`
+// under the given order, and its period.
+size_t MaximalSuffix(StringView needle, bool reversed, size_t* period) {
+  size_t before_suffix = kNotFound;
+  size_t pos = 0;
+  size_t offset = 1;
+  *period = 1;
+  while (pos + offset < needle.Size()) {
+    auto next = static_cast<unsigned char>(needle[pos + offset]);
+    auto ref = static_cast<unsigned char>(needle[before_suffix + offset]);
+    if (reversed ? ref < next : next < ref) {
+      pos += offset;
+      offset = 1;
+      *period = pos - before_suffix;
+    } else if (next != ref) {
+      before_suffix = pos++;
+      offset = *period = 1;
+    } else if (offset != *period) {
+      ++offset;
+    } else {
+      pos += *period;
+      offset = 1;
+    }
   }
-  SetNullSymbol(size_);
+  return before_suffix + 1;
 }
 
-String& String::operator=(const String& other) {
-  if (this == &other) {
-    return *this;
+// Scans the right half, then the left one; `memory` remembers how much of
+// the left half is known to match after a shift by a whole period.
+size_t TwoWayPeriodic(StringView hay, StringView needle, size_t split,
+                      size_t period) {
+  size_t memory = 0;
+  for (size_t pos = 0; pos + needle.Size() <= hay.Size();) {
+    size_t index = Max(split, memory);
+    while (index < needle.Size() && needle[index] == hay[pos + index]) {
+      ++index;
+    }
+    if (index < needle.Size()) {
+      pos += index - split + 1;
+      memory = 0;
+      continue;
+    }
+    index = split;
+    while (index > memory && needle[index - 1] == hay[pos + index - 1]) {
+      --index;
+    }
+    if (index <= memory) {
+      return pos;
+    }
+    pos += period;
+    memory = needle.Size() - period;
   }
-  delete[] characters_;
-  size_ = other.Size();
-  capacity_ = other.Capacity();
-  characters_ = new char[capacity_];
+  return kNotFound;
+}
 
-  for (size_t i = 0; i < other.Size(); ++i) {
-    characters_[i] = other[i];
+size_t TwoWayAperiodic(StringView hay, StringView needle, size_t split) {
+  size_t shift = Max(split, needle.Size() - split) + 1;
+  for (size_t pos = 0; pos + needle.Size() <= hay.Size();) {
+    size_t index = split;
+    while (index < needle.Size() && needle[index] == hay[pos + index]) {
+      ++index;
+    }
+    if (index < needle.Size()) {
+      pos += index - split + 1;
+      continue;
+    }
+    index = split;
+    while (index > 0 && needle[index - 1] == hay[pos + index - 1]) {
+      --index;
+    }
+    if (index == 0) {
+      return pos;
+    }
+    pos += shift;
   }
-  if (capacity_ != 0) {
-    SetNullSymbol(size_);
+  return kNotFound;
+}
+
+size_t FindTwoWay(StringView hay, StringView needle) {
+  size_t period = 0;
+  size_t reversed_period = 0;
+  size_t split = MaximalSuffix(needle, false, &period);
+  size_t reversed_split = MaximalSuffix(needle, true, &reversed_period);
+  if (reversed_split >= split) {
+    split = reversed_split;
+    period = reversed_period;
   }
 
-  return *this;
+  if (std::memcmp(needle.Data(), needle.Data() + period, split) == 0) {
+    return TwoWayPeriodic(hay, needle, split, period);
+  }
+  return TwoWayAperiodic(hay, needle, split);
 }
 
-void String::Clear() {
-  size_ = 0;
-  if (capacity_ == 0) {
-    return;
+// Single bytes go to memchr, needles up to kShortNeedle bytes to the vector
+// filter, whose worst case is then still linear, longer ones to Two-Way.
+size_t Find(StringView text, StringView needle, size_t from) {
+  if (from > text.Size() || needle.Size() > text.Size() - from) {
+    return kNotFound;
+  }
+  if (needle.Empty()) {
+    return from;
   }
-  SetNullSymbol(size_);
+  StringView hay(text.Data() + from, text.Size() - from);
+  size_t found = 0;
+  if (needle.Size() == 1) {
+    const void* match = std::memchr(hay.Data(), needle[0], hay.Size());
+    found = match == nullptr ? kNotFound
+                             : static_cast<const char*>(match) - hay.Data();
+  } else if (needle.Size() <= kShortNeedle) {
+    found = FindShort(hay, needle);
+  } else {
+    found = FindTwoWay(hay, needle);
+  }
+  return found == kNotFound ? kNotFound : from + found;
 }
 
-void String::PushBack(char character) {
-  if (size_ + 1 >= capacity_) {
-    Reserve(capacity_ * 2 + 2);
+// Walks candidates for the first byte backwards with memrchr.
+size_t RFind(StringView text, StringView needle, size_t from) {
+  if (needle.Size() > text.Size()) {
+    return kNotFound;
+  }
+  size_t pos = Min(from, text.Size() - needle.Size());
+  if (needle.Empty()) {
+    return pos;
   }
+  for (size_t end = pos + 1; end != 0; end = pos) {
+    const void* first = memrchr(text.Data(), needle[0], end);
+    if (first == nullptr) {
+      break;
+    }
+    pos = static_cast<const char*>(first) - text.Data();
+    if (std::memcmp(text.Data() + pos, needle.Data(), needle.Size()) == 0) {
+      return pos;
+    }
+  }
+  return kNotFound;
+}
 
-  characters_[size_++] = character;
-  SetNullSymbol(size_);
+size_t Count(StringView text, StringView needle) {
+  if (needle.Empty()) {
+    return text.Size() + 1;
+  }
+  size_t count = 0;
+  for (size_t pos = Find(text, needle, 0); pos != kNotFound;
+       pos = Find(text, needle, pos + needle.Size())) {
+    ++count;
+  }
+  return count;
 }
 
-void String::PopBack() {
-  if (Empty()) {
-    return;
+// Bytes compare as unsigned char, a proper prefix is smaller.
+int Compare(StringView lhs, StringView rhs) {
+  size_t common = Min(lhs.Size(), rhs.Size());
+  // A default StringView has no data, and memcmp must not see nullptr.
+  int result = common == 0 ? 0 : std::memcmp(lhs.Data(), rhs.Data(), common);
+  if (result != 0) {
+    return result;
   }
-  SetNullSymbol(--size_);
+  return lhs.Size() < rhs.Size() ? -1 : (lhs.Size() > rhs.Size() ? 1 : 0);
 }
 
-void String::Resize(size_t new_size) {
-  if (new_size > size_) {
-    Reserve(entrails::Max(new_size + 1, 2 * capacity_ + 1));
+void FillRepeating(char* data, size_t filled, size_t total) {
+  while (filled < total) {
+    size_t chunk = Min(filled, total - filled);
+    std::memcpy(data + filled, data, chunk);
+    filled += chunk;
   }
+}
+
+static constexpr uint64_t kHashMultiplier = 0x9e3779b97f4a7c15;
+static constexpr uint64_t kFinalMultiplier1 = 0xff51afd7ed558ccd;
+static constexpr uint64_t kFinalMultiplier2 = 0xc4ceb9fe1a85ec53;
+static constexpr int kFinalShift = 33;
+static constexpr int kWordRotation = 31;
 
-  size_ = new_size;
-  SetNullSymbol(size_);
+uint64_t LoadWord(const char* data, size_t size) {
+  uint64_t word = 0;
+  std::memcpy(&word, data, size);
+  return word;
 }
 
-void String::Reserve(size_t new_cap) {
-  if (new_cap < capacity_) {
-    return;
+// Eight bytes per multiply, then Murmur3's finalizer to spread the bits.
+uint64_t Hash(StringView text) {
+  uint64_t hash = text.Size() * kHashMultiplier;
+  size_t pos = 0;
+  for (; pos + sizeof(uint64_t) <= text.Size(); pos += sizeof(uint64_t)) {
+    uint64_t word = LoadWord(text.Data() + pos, sizeof(uint64_t));
+    hash = std::rotl((hash ^ word) * kHashMultiplier, kWordRotation);
+  }
+  if (pos != text.Size()) {
+    uint64_t word = LoadWord(text.Data() + pos, text.Size() - pos);
+    hash = std::rotl((hash ^ word) * kHashMultiplier, kWordRotation);
   }
 
-  char* new_data = new char[new_cap];
-  for (size_t i = 0; i < size_; ++i) {
-    new_data[i] = characters_[i];
+  hash = (hash ^ (hash >> kFinalShift)) * kFinalMultiplier1;
+  hash = (hash ^ (hash >> kFinalShift)) * kFinalMultiplier2;
+  return hash ^ (hash >> kFinalShift);
+}
+
+static constexpr size_t kMinSizeClass = 8;
+static constexpr size_t kQuantum = 16;
+static constexpr size_t kQuantumClassLimit = 128;
+static constexpr size_t kClassesPerDoubling = 4;
+
+size_t RoundUp(size_t size, size_t step) {
+  return (size + step - 1) / step * step;
+}
+
+// jemalloc's classes: 8, multiples of 16 up to 128, then four classes for
+// every doubling (160, 192, 224, 256, 320, ...).
+size_t SizeClass(size_t bytes) {
+  if (bytes <= kMinSizeClass) {
+    return kMinSizeClass;
   }
-  delete[] characters_;
-  characters_ = new_data;
-  capacity_ = new_cap;
-  SetNullSymbol(size_);
+  if (bytes <= kQuantumClassLimit) {
+    return RoundUp(bytes, kQuantum);
+  }
+  return RoundUp(bytes, std::bit_floor(bytes - 1) / kClassesPerDoubling);
+}
+
+// End of the piece starting at `from`; an empty delimiter never matches.
+size_t PieceEnd(StringView text, StringView delim, size_t from) {
+  size_t found = delim.Empty() ? kNotFound : Find(text, delim, from);
+  return found == kNotFound ? text.Size() : found;
 }
 
-void String::Resize(size_t new_size, char character) {
-  size_t prev_size = size_;
-  Resize(new_size);
-  for (size_t i = prev_size; i < new_size; ++i) {
-    characters_[i] = character;
+#ifdef __SSE2__
+// A byte is whitespace if it is ' ' or in '\t'..'\r', the second test done
+// as an unsigned (byte - '\t') <= '\r' - '\t'.
+const char* FindSpace(const char* begin, const char* end) {
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i range = _mm_set1_epi8('\r' - '\t');
+  for (; begin + kVectorSize <= end; begin += kVectorSize) {
+    __m128i block = LoadVector(begin);
+    __m128i shifted = _mm_sub_epi8(block, tab);
+    __m128i in_range =
+        _mm_cmpeq_epi8(_mm_min_epu8(shifted, range), shifted);
+    __m128i is_space = _mm_or_si128(in_range, _mm_cmpeq_epi8(block, space));
+    auto mask = static_cast<unsigned>(_mm_movemask_epi8(is_space));
+    if (mask != 0) {
+      return begin + std::countr_zero(mask);
+    }
   }
-  SetNullSymbol(size_);
+  while (begin != end && !Isspace(*begin)) {
+    ++begin;
+  }
+  return begin;
+}
+#else
+const char* FindSpace(const char* begin, const char* end) {
+  while (begin != end && !Isspace(*begin)) {
+    ++begin;
+  }
+  return begin;
+}
+#endif
+
+static constexpr unsigned char kAsciiLimit = 0x80;
+static constexpr unsigned char kContinuationMask = 0xC0;
+static constexpr unsigned char kContinuationTag = 0x80;
+static constexpr int kPayloadBits = 6;
+static constexpr char32_t kPayloadMask = 0x3F;
+static constexpr char32_t kMaxCodePoint = 0x10FFFF;
+static constexpr char32_t kSurrogateFirst = 0xD800;
+static constexpr char32_t kSurrogateLast = 0xDFFF;
+static constexpr char32_t kReplacementCharacter = 0xFFFD;
+static constexpr uint64_t kHighBits = 0x8080808080808080;
+
+// Lead bytes of two-, three- and four-byte sequences and the smallest code
+// point each may encode, which rules out overlong forms.
+struct LeadByte {
+  unsigned char mask;
+  unsigned char tag;
+  size_t length;
+  char32_t min;
+};
+
+static constexpr LeadByte kLeadBytes[] = {
+    {0xE0, 0xC0, 2, 0x80}, {0xF0, 0xE0, 3, 0x800}, {0xF8, 0xF0, 4, 0x10000}};
+
+bool IsContinuation(char byte) {
+  return (static_cast<unsigned char>(byte) & kContinuationMask) ==
+         kContinuationTag;
 }
 
-void String::ShrinkToFit() {
-  capacity_ = size_;
-  char* new_data = new char[capacity_];
-  for (size_t i = 0; i < size_; ++i) {
-    new_data[i] = characters_[i];
+// The number of leading ones of a lead byte is the sequence length.
+size_t DecodeCodePoint(StringView text, size_t pos, char32_t* code_point) {
+  auto lead = static_cast<unsigned char>(text[pos]);
+  *code_point = lead;
+  if (lead < kAsciiLimit) {
+    return 1;
+  }
+  *code_point = kReplacementCharacter;
+  auto length = static_cast<size_t>(std::countl_one(lead));
+  if (length < 2 || length > std::size(kLeadBytes) + 1 ||
+      length > text.Size() - pos) {
+    return 0;
   }
-  delete[] characters_;
-  characters_ = new_data;
+  const LeadByte& form = kLeadBytes[length - 2];
+  char32_t decoded = lead & static_cast<unsigned char>(~form.mask);
+  for (size_t index = pos + 1; index < pos + length; ++index) {
+    if (!IsContinuation(text[index])) {
+      return 0;
+    }
+    decoded = (decoded << kPayloadBits) | (text[index] & kPayloadMask);
+  }
+  if (decoded < form.min || decoded > kMaxCodePoint ||
+      (decoded >= kSurrogateFirst && decoded <= kSurrogateLast)) {
+    return 0;
+  }
+  *code_point = decoded;
+  return length;
 }
 
-void String::Swap(String& other) {
-  char* temp_data = other.characters_;
-  size_t temp_size = other.size_;
-  size_t temp_cap = other.capacity_;
+size_t EncodeCodePoint(char32_t code_point, char* out) {
+  if (code_point < kAsciiLimit) {
+    *out = static_cast<char>(code_point);
+    return 1;
+  }
+  const LeadByte* form = kLeadBytes;
+  while (form + 1 != std::end(kLeadBytes) && (form + 1)->min <= code_point) {
+    ++form;
+  }
+  for (size_t index = form->length - 1; index != 0; --index) {
+    out[index] = static_cast<char>(kContinuationTag |
+                                   (code_point & kPayloadMask));
+    code_point >>= kPayloadBits;
+  }
+  out[0] = static_cast<char>(form->tag | code_point);
+
+  return form->length;
+}
 
-  other.characters_ = characters_;
-  other.size_ = size_;
-  other.capacity_ = capacity_;
+// Word at a time up to the first byte that is not ASCII.
+size_t SkipAscii(StringView text, size_t pos) {
+  for (; pos + sizeof(uint64_t) <= text.Size(); pos += sizeof(uint64_t)) {
+    if ((LoadWord(text.Data() + pos, sizeof(uint64_t)) & kHighBits) != 0) {
+      break;
+    }
+  }
+  while (pos < text.Size() &&
+         static_cast<unsigned char>(text[pos]) < kAsciiLimit) {
+    ++pos;
+  }
+  return pos;
+}
 
-  characters_ = temp_data;
-  size_ = temp_size;
-  capacity_ = temp_cap;
+bool IsValidUtf8Scalar(StringView text) {
+  char32_t code_point = 0;
+  for (size_t pos = SkipAscii(text, 0); pos < text.Size();
+       pos = SkipAscii(text, pos)) {
+    size_t length = DecodeCodePoint(text, pos, &code_point);
+    if (length == 0) {
+      return false;
+    }
+    pos += length;
+  }
+  return true;
 }
 
-char& String::Front() { return characters_[0]; }
+#ifdef __SSE2__
+// Keiser and Lemire's validator ("Validating UTF-8 In Less Than One
+// Instruction Per Byte"): three 16-entry table lookups on the nibbles of
+// each byte and the one before it classify every two-byte window at once.
+// Each bit of a lookup result stands for one kind of error; a window is
+// wrong when all three lookups agree on a bit.
+static constexpr unsigned char kTooShort = 1U << 0;
+static constexpr unsigned char kTooLong = 1U << 1;
+static constexpr unsigned char kOverlong3 = 1U << 2;
+static constexpr unsigned char kTooLarge = 1U << 3;
+static constexpr unsigned char kSurrogate = 1U << 4;
+static constexpr unsigned char kOverlong2 = 1U << 5;
+static constexpr unsigned char kTooLarge1000 = 1U << 6;
+static constexpr unsigned char kOverlong4 = 1U << 6;
+static constexpr unsigned char kTwoContinuations = 1U << 7;
+static constexpr unsigned char kCarry =
+    kTooShort | kTooLong | kTwoContinuations;
+static constexpr unsigned char kLowNibble = 0x0F;
+static constexpr int kNibbleBits = 4;
+static constexpr unsigned char kThreeByteLead = 0xE0;
+static constexpr unsigned char kFourByteLead = 0xF0;
+
+static constexpr unsigned char kLarge = kCarry | kTooLarge | kTooLarge1000;
+static constexpr unsigned char kAnyContinuation =
+    kTooLong | kOverlong2 | kTwoContinuations;
+
+// Indexed by the high nibble of the first byte of a window.
+static constexpr unsigned char kFirstHighTable[] = {
+    kTooLong,
+    kTooLong,
+    kTooLong,
+    kTooLong,
+    kTooLong,
+    kTooLong,
+    kTooLong,
+    kTooLong,
+    kTwoContinuations,
+    kTwoContinuations,
+    kTwoContinuations,
+    kTwoContinuations,
+    kTooShort | kOverlong2,
+    kTooShort,
+    kTooShort | kOverlong3 | kSurrogate,
+    kTooShort | kTooLarge | kTooLarge1000 | kOverlong4,
+};
+
+// Indexed by the low nibble of the first byte.
+static constexpr unsigned char kFirstLowTable[] = {
+    kCarry | kOverlong3 | kOverlong2 | kOverlong4,
+    kCarry | kOverlong2,
+    kCarry,
+    kCarry,
+    kCarry | kTooLarge,
+    kLarge,
+    kLarge,
+    kLarge,
+    kLarge,
+    kLarge,
+    kLarge,
+    kLarge,
+    kLarge,
+    kLarge | kSurrogate,
+    kLarge,
+    kLarge,
+};
+
+// Indexed by the high nibble of the second byte.
+static constexpr unsigned char kSecondHighTable[] = {
+    kTooShort,
+    kTooShort,
+    kTooShort,
+    kTooShort,
+    kTooShort,
+    kTooShort,
+    kTooShort,
+    kTooShort,
+    kAnyContinuation | kOverlong3 | kTooLarge1000 | kOverlong4,
+    kAnyContinuation | kOverlong3 | kTooLarge,
+    kAnyContinuation | kSurrogate | kTooLarge,
+    kAnyContinuation | kSurrogate | kTooLarge,
+    kTooShort,
+    kTooShort,
+    kTooShort,
+    kTooShort,
+};
+
+// Bytes above these in the last three positions start a sequence that the
+// block cuts off.
+static constexpr unsigned char kCompleteTail[] = {
+    UCHAR_MAX,          UCHAR_MAX,          UCHAR_MAX,
+    UCHAR_MAX,          UCHAR_MAX,          UCHAR_MAX,
+    UCHAR_MAX,          UCHAR_MAX,          UCHAR_MAX,
+    UCHAR_MAX,          UCHAR_MAX,          UCHAR_MAX,
+    UCHAR_MAX,          kFourByteLead - 1,  kThreeByteLead - 1,
+    kContinuationMask - 1,
+};
+
+static_assert(sizeof(kFirstHighTable) == kVectorSize &&
+              sizeof(kFirstLowTable) == kVectorSize &&
+              sizeof(kSecondHighTable) == kVectorSize &&
+              sizeof(kCompleteTail) == kVectorSize);
+
+__m128i LoadTable(const unsigned char* table) {
+  return LoadVector(reinterpret_cast<const char*>(table));
+}
 
-char& String::Back() { return characters_[size_ - 1]; }
+// The build only assumes SSE2, so the pshufb lookups are compiled for
+// SSSE3 separately and chosen at run time.
+[[gnu::target("ssse3")]] __m128i HighNibbles(__m128i block) {
+  return _mm_and_si128(_mm_srli_epi16(block, kNibbleBits),
+                       _mm_set1_epi8(kLowNibble));
+}
 
-const char& String::Front() const { return characters_[0]; }
+[[gnu::target("ssse3")]] __m128i CheckBlock(__m128i input, __m128i prev) {
+  __m128i prev1 = _mm_alignr_epi8(input, prev, kVectorSize - 1);
+  __m128i low = _mm_and_si128(prev1, _mm_set1_epi8(kLowNibble));
+  __m128i errors = _mm_and_si128(
+      _mm_and_si128(
+          _mm_shuffle_epi8(LoadTable(kFirstHighTable), HighNibbles(prev1)),
+          _mm_shuffle_epi8(LoadTable(kFirstLowTable), low)),
+      _mm_shuffle_epi8(LoadTable(kSecondHighTable), HighNibbles(input)));
+
+  // Two continuations in a row are fine only as the third or fourth byte
+  // of a sequence whose lead is two or three bytes back.
+  __m128i prev2 = _mm_alignr_epi8(input, prev, kVectorSize - 2);
+  __m128i prev3 = _mm_alignr_epi8(input, prev, kVectorSize - 2 - 1);
+  __m128i third = _mm_subs_epu8(
+      prev2, _mm_set1_epi8(kThreeByteLead - kContinuationTag));
+  __m128i fourth = _mm_subs_epu8(
+      prev3, _mm_set1_epi8(kFourByteLead - kContinuationTag));
+  __m128i expected = _mm_and_si128(_mm_or_si128(third, fourth),
+                                   _mm_set1_epi8(kTwoContinuations));
+  return _mm_xor_si128(expected, errors);
+}
 
-const char& String::Back() const { return characters_[size_ - 1]; }
+[[gnu::target("ssse3")]] __m128i IncompleteTail(__m128i input) {
+  return _mm_subs_epu8(input, LoadTable(kCompleteTail));
+}
 
-bool String::Empty() const { return Size() == 0; }
+struct Utf8Checker {
+  __m128i error;
+  __m128i prev;
+  __m128i prev_incomplete;
+};
+
+[[gnu::target("ssse3")]] void CheckNext(Utf8Checker* checker,
+                                        __m128i input) {
+  if (_mm_movemask_epi8(input) == 0) {
+    checker->error = _mm_or_si128(checker->error, checker->prev_incomplete);
+    checker->prev_incomplete = _mm_setzero_si128();
+  } else {
+    checker->error =
+        _mm_or_si128(checker->error, CheckBlock(input, checker->prev));
+    checker->prev_incomplete = IncompleteTail(input);
+  }
+  checker->prev = input;
+}
 
-size_t String::Size() const { return size_; }
+// The tail is padded with zeros, which are ASCII.
+[[gnu::target("ssse3")]] bool IsValidUtf8Ssse3(StringView text) {
+  Utf8Checker checker{_mm_setzero_si128(), _mm_setzero_si128(),
+                      _mm_setzero_si128()};
+  size_t pos = 0;
+  for (; pos + kVectorSize <= text.Size(); pos += kVectorSize) {
+    CheckNext(&checker, LoadVector(text.Data() + pos));
+  }
+  if (pos != text.Size()) {
+    char tail[kVectorSize] = {};
+    std::memcpy(tail, text.Data() + pos, text.Size() - pos);
+    CheckNext(&checker, LoadVector(tail));
+  }
 
-size_t String::Capacity() const { return capacity_; }
+  __m128i error = _mm_or_si128(checker.error, checker.prev_incomplete);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) ==
+         (1 << kVectorSize) - 1;
+}
 
-char* String::Data() { return characters_; }
+bool IsValidUtf8(StringView text) {
+  static const bool kHasSsse3 = __builtin_cpu_supports("ssse3");
+  return kHasSsse3 ? IsValidUtf8Ssse3(text) : IsValidUtf8Scalar(text);
+}
 
-const char* String::Data() const { return characters_; }
+// Continuation bytes are the signed bytes below -64 (0xC0).
+size_t CountCodePoints(StringView text) {
+  const __m128i last_continuation =
+      _mm_set1_epi8(static_cast<char>(kContinuationMask - 1));
+  size_t count = 0;
+  size_t pos = 0;
+  for (; pos + kVectorSize <= text.Size(); pos += kVectorSize) {
+    __m128i is_lead =
+        _mm_cmpgt_epi8(LoadVector(text.Data() + pos), last_continuation);
+    count += std::popcount(static_cast<unsigned>(_mm_movemask_epi8(is_lead)));
+  }
+  for (; pos < text.Size(); ++pos) {
+    count += IsContinuation(text[pos]) ? 0 : 1;
+  }
+  return count;
+}
+#else
+bool IsValidUtf8(StringView text) { return IsValidUtf8Scalar(text); }
 
-char& String::operator[](size_t index) { return characters_[index]; }
+size_t CountCodePoints(StringView text) {
+  size_t count = 0;
+  for (size_t pos = 0; pos < text.Size(); ++pos) {
+    count += IsContinuation(text[pos]) ? 0 : 1;
+  }
+  return count;
+}
+#endif
+
+// Ranges of CaseFolding.txt's simple foldings, sorted; in the alternating
+// ones only every other code point, starting with the first, is uppercase.
+struct FoldRange {
+  char32_t first;
+  char32_t last;
+  int32_t delta;
+  bool alternating;
+};
+
+static constexpr FoldRange kFoldRanges[] = {
+    // ASCII, Latin-1 and Latin Extended-A.
+    {0x41, 0x5A, 0x20, false},
+    {0xB5, 0xB5, 0x3BC - 0xB5, false},
+    {0xC0, 0xD6, 0x20, false},
+    {0xD8, 0xDE, 0x20, false},
+    {0x100, 0x12F, 1, true},
+    {0x132, 0x137, 1, true},
+    {0x139, 0x148, 1, true},
+    {0x14A, 0x177, 1, true},
+    {0x178, 0x178, 0xFF - 0x178, false},
+    {0x179, 0x17E, 1, true},
+    {0x17F, 0x17F, 0x73 - 0x17F, false},
+    // Greek, with the iota subscript of Combining Diacritical Marks.
+    {0x345, 0x345, 0x3B9 - 0x345, false},
+    {0x370, 0x373, 1, true},
+    {0x376, 0x376, 1, false},
+    {0x37F, 0x37F, 0x3F3 - 0x37F, false},
+    {0x386, 0x386, 0x3AC - 0x386, false},
+    {0x388, 0x38A, 0x3AD - 0x388, false},
+    {0x38C, 0x38C, 0x3CC - 0x38C, false},
+    {0x38E, 0x38F, 0x3CD - 0x38E, false},
+    {0x391, 0x3A1, 0x20, false},
+    {0x3A3, 0x3AB, 0x20, false},
+    {0x3C2, 0x3C2, 1, false},
+    {0x3CF, 0x3CF, 0x3D7 - 0x3CF, false},
+    {0x3D0, 0x3D0, 0x3B2 - 0x3D0, false},
+    {0x3D1, 0x3D1, 0x3B8 - 0x3D1, false},
+    {0x3D5, 0x3D5, 0x3C6 - 0x3D5, false},
+    {0x3D6, 0x3D6, 0x3C0 - 0x3D6, false},
+    {0x3D8, 0x3EF, 1, true},
+    {0x3F0, 0x3F0, 0x3BA - 0x3F0, false},
+    {0x3F1, 0x3F1, 0x3C1 - 0x3F1, false},
+    {0x3F4, 0x3F4, 0x3B8 - 0x3F4, false},
+    {0x3F5, 0x3F5, 0x3B5 - 0x3F5, false},
+    {0x3F7, 0x3F7, 1, false},
+    {0x3F9, 0x3F9, 0x3F2 - 0x3F9, false},
+    {0x3FA, 0x3FA, 1, false},
+    {0x3FD, 0x3FF, 0x37B - 0x3FD, false},
+    // Cyrillic and Cyrillic Supplement.
+    {0x400, 0x40F, 0x50, false},
+    {0x410, 0x42F, 0x20, false},
+    {0x460, 0x481, 1, true},
+    {0x48A, 0x4BF, 1, true},
+    {0x4C0, 0x4C0, 0x4CF - 0x4C0, false},
+    {0x4C1, 0x4CE, 1, true},
+    {0x4D0, 0x52F, 1, true},
+};
+
+static constexpr char32_t kLastFolded = std::end(kFoldRanges)[-1].last;
+
+// kFoldRanges expanded so that folding is a single load.
+static constexpr auto kFolded = [] {
+  std::array<char16_t, kLastFolded + 1> folded{};
+  for (char32_t code_point = 0; code_point <= kLastFolded; ++code_point) {
+    folded[code_point] = static_cast<char16_t>(code_point);
+  }
+  for (const FoldRange& range : kFoldRanges) {
+    for (char32_t code_point = range.first; code_point <= range.last;
+         code_point += range.alternating ? 2 : 1) {
+      folded[code_point] =
+          static_cast<char16_t>(static_cast<int32_t>(code_point) + range.delta);
+    }
+  }
+  return folded;
+}();
 
-const char& String::operator[](size_t index) const {
-  return characters_[index];
+char32_t FoldCodePoint(char32_t code_point) {
+  return code_point <= kLastFolded ? kFolded[code_point] : code_point;
 }
 
-void String::SetNullSymbol(size_t index) { characters_[index] = '\0'; }
+static_assert(kLastFolded < kLeadBytes[1].min, "folding is two-byte only");
+static constexpr unsigned char kLastFoldedLead =
+    kLeadBytes[0].tag | (kLastFolded >> kPayloadBits);
 
-std::vector<String> String::Split(const String& delim) {
-  if (Empty() || delim.Empty()) {
-    return {*this};
-  }
-  std::vector<String> substrings;
+// Continuation bytes and leads past kLastFoldedLead never start a folding
+// sequence.
+bool MayFold(char byte) {
+  return static_cast<unsigned char>(byte) <= kLastFoldedLead &&
+         !IsContinuation(byte);
+}
 
-  size_t delim_pointer = 0;
-  String buffer;
-  for (size_t i = 0; i < size_; ++i) {
-    if (characters_[i] == delim[delim_pointer]) {
-      ++delim_pointer;
-    } else {
-      delim_pointer = 0;
+// Called where MayFold holds, so the lead is ASCII or starts a two-byte
+// sequence; invalid sequences are copied a byte at a time.
+size_t FoldSequence(StringView text, size_t pos, char* out, size_t* written) {
+  auto lead = static_cast<unsigned char>(text[pos]);
+  char32_t code_point = lead;
+  size_t length = 1;
+  if (lead >= kAsciiLimit) {
+    if (pos + 1 < text.Size() && IsContinuation(text[pos + 1])) {
+      code_point = (lead & static_cast<unsigned char>(~kLeadBytes[0].mask))
+                       << kPayloadBits |
+                   (text[pos + 1] & kPayloadMask);
+      length = 2;
     }
+    if (length == 1 || code_point < kLeadBytes[0].min) {
+      out[(*written)++] = text[pos];
+      return pos + 1;
+    }
+  }
+  *written += EncodeCodePoint(FoldCodePoint(code_point), out + *written);
+  return pos + length;
+}
+
+#ifdef __SSE2__
+// Adding 0x80 - 'A' moves 'A'..'Z' to the 26 smallest signed bytes.
+__m128i IsAsciiUpper(__m128i block) {
+  constexpr int kSignFlip = 0x80;
+  __m128i shifted =
+      _mm_add_epi8(block, _mm_set1_epi8(static_cast<char>(kSignFlip - 'A')));
+  return _mm_cmplt_epi8(
+      shifted, _mm_set1_epi8(static_cast<char>(kSignFlip + 'Z' - 'A' + 1)));
+}
+
+// Bit i is set if byte i may start a sequence that folds: an uppercase
+// letter or a lead from 0xC0 to kLastFoldedLead, compared as signed bytes.
+unsigned FoldCandidates(__m128i block) {
+  __m128i lead = _mm_and_si128(
+      _mm_cmpgt_epi8(block,
+                     _mm_set1_epi8(static_cast<char>(kContinuationMask - 1))),
+      _mm_cmplt_epi8(block,
+                     _mm_set1_epi8(static_cast<char>(kLastFoldedLead + 1))));
+  return static_cast<unsigned>(
+      _mm_movemask_epi8(_mm_or_si128(lead, IsAsciiUpper(block))));
+}
+
+__m128i LowerAscii(__m128i block) {
+  return _mm_add_epi8(
+      block, _mm_and_si128(IsAsciiUpper(block), _mm_set1_epi8('a' - 'A')));
+}
 
-    buffer.PushBack(characters_[i]);
-    if (delim_pointer != delim.Size()) {
+void CopyBytes(StringView text, size_t from, size_t to, char* out,
+               size_t* written) {
+  std::memcpy(out + *written, text.Data() + from, to - from);
+  *written += to - from;
+}
+
+// Folds a block that is not all ASCII, together with the rest of a sequence
+// crossing its end; returns where the next block starts.
+size_t FoldMixedBlock(StringView text, size_t pos, __m128i block, char* out,
+                      size_t* written) {
+  size_t block_start = pos;
+  size_t block_end = pos + kVectorSize;
+  for (unsigned mask = FoldCandidates(block); mask != 0; mask &= mask - 1) {
+    size_t candidate = block_start + std::countr_zero(mask);
+    if (candidate >= pos) {
+      CopyBytes(text, pos, candidate, out, written);
+      pos = FoldSequence(text, candidate, out, written);
+    }
+  }
+  if (pos < block_end) {
+    CopyBytes(text, pos, block_end, out, written);
+    pos = block_end;
+  }
+  return pos;
+}
+#endif
+
+size_t FoldCase(StringView text, char* out) {
+  size_t pos = 0;
+  size_t written = 0;
+#ifdef __SSE2__
+  while (pos + kVectorSize <= text.Size()) {
+    __m128i block = LoadVector(text.Data() + pos);
+    if (_mm_movemask_epi8(block) != 0) {
+      pos = FoldMixedBlock(text, pos, block, out, &written);
       continue;
     }
-
-    while (delim_pointer != 0) {
-      buffer.PopBack();
-      --delim_pointer;
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + written),
+                     LowerAscii(block));
+    pos += kVectorSize;
+    written += kVectorSize;
+  }
+#endif
+  while (pos < text.Size()) {
+    if (MayFold(text[pos])) {
+      pos = FoldSequence(text, pos, out, &written);
+    } else {
+      out[written++] = text[pos++];
     }
-    substrings.push_back(buffer);
-    buffer.Clear();
   }
-  substrings.push_back(buffer);
+  return written;
+}
+
+template <typename Number>
+size_t FormatWithToChars(Number value, char* out) {
+  return static_cast<size_t>(
+      std::to_chars(out, out + kMaxNumberLength, value).ptr - out);
+}
+
+size_t FormatNumber(int64_t value, char* out) {
+  return FormatWithToChars(value, out);
+}
+
+size_t FormatNumber(uint64_t value, char* out) {
+  return FormatWithToChars(value, out);
+}
+
+size_t FormatNumber(double value, char* out) {
+  return FormatWithToChars(value, out);
+}
+
+// Only all of `text` counts as a number.
+template <typename Number>
+std::errc ParseWithFromChars(StringView text, Number* value) {
+  Number parsed{};
+  const char* end = text.Data() + text.Size();
+  auto [stop, error] = std::from_chars(text.Data(), end, parsed);
+  if (stop != end) {
+    return std::errc::invalid_argument;
+  }
+  if (error == std::errc()) {
+    *value = parsed;
+  }
+  return error;
+}
+
+// Older libstdc++ reports every underflow as out of range, subnormals
+// included, and stores nothing; strtod_l in the "C" locale, which those
+// versions call underneath, tells subnormals apart from values that really
+// are out of range. Texts longer than AppendNumber ever writes are still
+// rejected.
+bool ParseSubnormal(StringView text, double* value) {
+  static const locale_t kCLocale = newlocale(LC_ALL_MASK, "C", nullptr);
+  if (text.Size() > kMaxNumberLength || kCLocale == nullptr) {
+    return false;
+  }
+  char terminated[kMaxNumberLength + 1];
+  std::memcpy(terminated, text.Data(), text.Size());
+  terminated[text.Size()] = '\0';
+  char* stop = nullptr;
+  double parsed = strtod_l(terminated, &stop, kCLocale);
+  if (stop != terminated + text.Size() || parsed == 0 || std::isinf(parsed)) {
+    return false;
+  }
+  *value = parsed;
+  return true;
+}
+
+bool ParseNumber(StringView text, int64_t* value) {
+  return ParseWithFromChars(text, value) == std::errc();
+}
+
+bool ParseNumber(StringView text, uint64_t* value) {
+  return ParseWithFromChars(text, value) == std::errc();
+}
+
+bool ParseNumber(StringView text, double* value) {
+  std::errc error = ParseWithFromChars(text, value);
+  return error == std::errc() || (error == std::errc::result_out_of_range &&
+                                  ParseSubnormal(text, value));
+}
+
+}  // namespace entrails
+
+static_assert(std::endian::native == std::endian::little,
+              "the small/large tag lives in the top byte of the capacity");
+static_assert(sizeof(String) == 3 * sizeof(size_t));
+
+template class BasicString<std::allocator<char>>;
+
+StringMemoryStats GetStringMemoryStats() {
+  const entrails::MemoryCounters& counters = entrails::memory_counters;
+  return {counters.allocations.load(std::memory_order_relaxed),
+          counters.deallocations.load(std::memory_order_relaxed),
+          counters.reallocations.load(std::memory_order_relaxed),
+          counters.allocated_bytes.load(std::memory_order_relaxed),
+          counters.live_bytes.load(std::memory_order_relaxed)};
+}
+
+// Live bytes describe buffers that still exist, so they are kept.
+void ResetStringMemoryStats() {
+  entrails::MemoryCounters& counters = entrails::memory_counters;
+  counters.allocations.store(0, std::memory_order_relaxed);
+  counters.deallocations.store(0, std::memory_order_relaxed);
+  counters.reallocations.store(0, std::memory_order_relaxed);
+  counters.allocated_bytes.store(0, std::memory_order_relaxed);
+}
+
+std::ostream& operator<<(std::ostream& ostream, StringView view) {
+  ostream.write(view.Data(), static_cast<std::streamsize>(view.Size()));
+
+  return ostream;
+}
+
+StringView::StringView(const char* data, size_t size)
+    : data_(data), size_(size) {}
+
+StringView::StringView(const char* raw_string)
+    : data_(raw_string), size_(std::strlen(raw_string)) {}
+
+bool StringView::Empty() const { return size_ == 0; }
+
+size_t StringView::Size() const { return size_; }
+
+const char* StringView::Data() const { return data_; }
+
+const char& StringView::operator[](size_t index) const { return data_[index]; }
+
+SplitRange::SplitRange(StringView text, StringView delim)
+    : text_(text), delim_(delim) {}
+
+SplitRange::Iterator SplitRange::begin() const { return {text_, delim_}; }
+
+SplitRange::Iterator SplitRange::end() const { return {}; }
+
+SplitRange::Iterator::Iterator(StringView text, StringView delim)
+    : text_(text),
+      delim_(delim),
+      end_(entrails::PieceEnd(text, delim, 0)),
+      done_(false) {}
+
+StringView SplitRange::Iterator::operator*() const {
+  return {text_.Data() + begin_, end_ - begin_};
+}
+
+SplitRange::Iterator& SplitRange::Iterator::operator++() {
+  if (end_ == text_.Size()) {
+    done_ = true;
+    return *this;
+  }
+  begin_ = end_ + delim_.Size();
+  end_ = entrails::PieceEnd(text_, delim_, begin_);
+
+  return *this;
+}
+
+SplitRange::Iterator SplitRange::Iterator::operator++(int) {
+  Iterator previous = *this;
+  ++*this;
+
+  return previous;
+}
+
+bool SplitRange::Iterator::operator==(const Iterator& other) const {
+  return done_ == other.done_ && (done_ || begin_ == other.begin_);
+}
+
+CodePointRange::CodePointRange(StringView text) : text_(text) {}
+
+CodePointRange::Iterator CodePointRange::begin() const { return {text_, 0}; }
+
+CodePointRange::Iterator CodePointRange::end() const {
+  return {text_, text_.Size()};
+}
+
+CodePointRange::Iterator::Iterator(StringView text, size_t pos)
+    : text_(text), pos_(pos) {
+  Decode();
+}
+
+char32_t CodePointRange::Iterator::operator*() const { return code_point_; }
+
+CodePointRange::Iterator& CodePointRange::Iterator::operator++() {
+  pos_ += length_;
+  Decode();
+
+  return *this;
+}
+
+CodePointRange::Iterator CodePointRange::Iterator::operator++(int) {
+  Iterator previous = *this;
+  ++*this;
+
+  return previous;
+}
+
+bool CodePointRange::Iterator::operator==(const Iterator& other) const {
+  return pos_ == other.pos_;
+}
+
+void CodePointRange::Iterator::Decode() {
+  if (pos_ < text_.Size()) {
+    length_ = entrails::Max(
+        entrails::DecodeCodePoint(text_, pos_, &code_point_), 1);
+  }
+}
+
+SharedString::SharedString(StringView view) : size_(view.Size()) {
+  if (view.Empty()) {
+    return;
+  }
+  void* memory = ::operator new(sizeof(Block) + view.Size());
+  block_ = new (memory) Block{1};
+  char* data = reinterpret_cast<char*>(block_ + 1);
+  std::memcpy(data, view.Data(), view.Size());
+  data_ = data;
+}
+
+SharedString::SharedString(const SharedString& other) noexcept
+    : block_(other.block_), data_(other.data_), size_(other.size_) {
+  if (block_ != nullptr) {
+    block_->references.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+SharedString::SharedString(SharedString&& other) noexcept
+    : block_(other.block_), data_(other.data_), size_(other.size_) {
+  other.block_ = nullptr;
+  other.data_ = "";
+  other.size_ = 0;
+}
+
+SharedString& SharedString::operator=(const SharedString& other) noexcept {
+  SharedString copy = other;
+  Swap(copy);
+
+  return *this;
+}
+
+SharedString& SharedString::operator=(SharedString&& other) noexcept {
+  SharedString moved = std::move(other);
+  Swap(moved);
+
+  return *this;
+}
+
+SharedString::~SharedString() { Release(); }
+
+// The last owner frees the block; acq_rel makes every other owner's reads
+// happen before that.
+void SharedString::Release() {
+  if (block_ != nullptr &&
+      block_->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    block_->~Block();
+    ::operator delete(block_);
+  }
+}
+
+bool SharedString::Empty() const { return size_ == 0; }
+
+size_t SharedString::Size() const { return size_; }
+
+const char* SharedString::Data() const { return data_; }
 
-  return substrings;
+const char& SharedString::operator[](size_t index) const {
+  return data_[index];
 }
 
-String String::Join(const std::vector<String>& strings) const {
-  if (strings.empty()) {
-    return "";
+size_t SharedString::UseCount() const {
+  return block_ == nullptr ? 0
+                           : block_->references.load(std::memory_order_relaxed);
+}
+
+SharedString SharedString::Substr(size_t pos, size_t count) const {
+  pos = entrails::Min(pos, size_);
+  SharedString slice = *this;
+  slice.data_ += pos;
+  slice.size_ = entrails::Min(count, size_ - pos);
+
+  return slice;
+}
+
+int SharedString::Compare(StringView other) const {
+  return entrails::Compare(*this, other);
+}
+
+void SharedString::Swap(SharedString& other) noexcept {
+  std::swap(block_, other.block_);
+  std::swap(data_, other.data_);
+  std::swap(size_, other.size_);
+}
+
+SharedString::operator StringView() const { return {data_, size_}; }
+
+StringBuilder::StringBuilder(StringBuilder&& other) noexcept
+    : pieces_(std::move(other.pieces_)),
+      chunks_(std::move(other.chunks_)),
+      shared_(std::move(other.shared_)),
+      free_(std::exchange(other.free_, nullptr)),
+      free_size_(std::exchange(other.free_size_, 0)),
+      size_(std::exchange(other.size_, 0)) {}
+
+StringBuilder& StringBuilder::operator=(StringBuilder&& other) noexcept {
+  StringBuilder moved = std::move(other);
+  std::swap(pieces_, moved.pieces_);
+  std::swap(chunks_, moved.chunks_);
+  std::swap(shared_, moved.shared_);
+  std::swap(free_, moved.free_);
+  std::swap(free_size_, moved.free_size_);
+  std::swap(size_, moved.size_);
+
+  return *this;
+}
+
+StringBuilder& StringBuilder::Append(StringView view) {
+  if (view.Empty()) {
+    return *this;
   }
-  String new_string = strings[0];
+  char* data = Allocate(view.Size());
+  std::memcpy(data, view.Data(), view.Size());
+  AddPiece({data, view.Size()});
 
-  for (size_t i = 1; i < strings.size(); ++i) {
-    new_string += (*this + strings[i]);
+  return *this;
+}
+
+StringBuilder& StringBuilder::Append(const SharedString& string) {
+  if (string.Empty()) {
+    return *this;
   }
+  shared_.push_back(string);
+  AddPiece(string);
 
-  return new_string;
+  return *this;
 }
 
-String& String::operator+=(const String& other) {
-  Reserve(size_ + other.size_);
-  for (size_t i = 0; i < other.Size(); ++i) {
-    PushBack(other[i]);
+StringBuilder& StringBuilder::AppendView(StringView view) {
+  if (!view.Empty()) {
+    AddPiece(view);
   }
+
   return *this;
 }
 
-String& String::operator*=(size_t count) {
-  if (count == 0) {
-    Clear();
+StringBuilder& StringBuilder::AppendRepeat(StringView view, size_t count) {
+  if (view.Empty() || count == 0) {
     return *this;
   }
-  String copy = *this;
-  copy.Reserve(copy.Size() * (count - 1));
-  for (size_t i = 0; i < count - 1; ++i) {
-    *this += copy;
+  size_t per_block = entrails::Max(
+      1, entrails::Min(count, kMaxChunk / view.Size()));
+  size_t block_size = view.Size() * per_block;
+  char* block = Allocate(block_size);
+  std::memcpy(block, view.Data(), view.Size());
+  entrails::FillRepeating(block, view.Size(), block_size);
+
+  for (; count >= per_block; count -= per_block) {
+    AddPiece({block, block_size});
+  }
+  if (count != 0) {
+    AddPiece({block, view.Size() * count});
   }
 
   return *this;
 }
 
-String operator+(const String& lhs, const String& rhs) {
-  String new_string = lhs;
+bool StringBuilder::Empty() const { return size_ == 0; }
+
+size_t StringBuilder::Size() const { return size_; }
+
+size_t StringBuilder::PieceCount() const { return pieces_.size(); }
+
+// Pieces of kMaxChunk or more get a chunk of their own and leave the current
+// one to later appends; new chunks grow with the output up to kMaxChunk.
+char* StringBuilder::Allocate(size_t size) {
+  if (size <= free_size_) {
+    char* data = free_;
+    free_ += size;
+    free_size_ -= size;
+    return data;
+  }
+  if (size >= kMaxChunk) {
+    return NewChunk(size);
+  }
+  size_t chunk =
+      entrails::Max(size, entrails::Min(entrails::Max(size_, kMinChunk),
+                                        kMaxChunk));
+  free_ = NewChunk(chunk) + size;
+  free_size_ = chunk - size;
+
+  return free_ - size;
+}
+
+// The buffer is owned before emplace_back, which may throw, is called.
+char* StringBuilder::NewChunk(size_t size) {
+  std::unique_ptr<char[]> chunk = std::make_unique_for_overwrite<char[]>(size);
+  return chunks_.emplace_back(std::move(chunk)).get();
+}
 
-  new_string += rhs;
+void StringBuilder::AddPiece(StringView piece) {
+  size_ += piece.Size();
+  if (!pieces_.empty()) {
+    StringView& last = pieces_.back();
+    if (last.Data() + last.Size() == piece.Data()) {
+      last = {last.Data(), last.Size() + piece.Size()};
+      return;
+    }
+  }
+  pieces_.push_back(piece);
+}
 
-  return new_string;
+namespace entrails {
+// Up to IOV_MAX pieces starting `offset` bytes into `pieces[first]`.
+std::vector<iovec> Gather(const std::vector<StringView>& pieces, size_t first,
+                          size_t offset) {
+  size_t last = entrails::Min(pieces.size(), first + IOV_MAX);
+  std::vector<iovec> vectors;
+  vectors.reserve(last - first);
+  for (size_t index = first; index < last; ++index) {
+    // writev does not write through iov_base, the cast only drops const.
+    char* data = const_cast<char*>(pieces[index].Data());
+    vectors.push_back({data + offset, pieces[index].Size() - offset});
+    offset = 0;
+  }
+  return vectors;
 }
+}  // namespace entrails
 
-bool operator>(const String& lhs, const String& rhs) {
-  size_t size = entrails::Min(lhs.Size(), rhs.Size());
-  for (size_t i = 0; i < size; ++i) {
-    if (lhs[i] < rhs[i]) {
+bool StringBuilder::WriteTo(int fd) const {
+  size_t first = 0;
+  size_t offset = 0;
+  while (first < pieces_.size()) {
+    std::vector<iovec> vectors = entrails::Gather(pieces_, first, offset);
+    ssize_t written =
+        writev(fd, vectors.data(), static_cast<int>(vectors.size()));
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
       return false;
     }
-    if (lhs[i] > rhs[i]) {
-      return true;
+    auto left = static_cast<size_t>(written) + offset;
+    while (first < pieces_.size() && left >= pieces_[first].Size()) {
+      left -= pieces_[first++].Size();
     }
+    offset = left;
   }
-  return lhs.Size() > rhs.Size();
+
+  return true;
 }
 
-bool operator>=(const String& lhs, const String& rhs) { return !(lhs < rhs); }
+InternedString::InternedString(const Entry* entry) : entry_(entry) {}
 
-bool operator<(const String& lhs, const String& rhs) { return rhs > lhs; }
+bool InternedString::Empty() const { return entry_ == nullptr; }
 
-bool operator<=(const String& lhs, const String& rhs) { return rhs >= lhs; }
+size_t InternedString::Size() const {
+  return entry_ == nullptr ? 0 : entry_->size;
+}
 
-bool operator==(const String& lhs, const String& rhs) {
-  if (lhs.Size() != rhs.Size()) {
-    return false;
+const char* InternedString::Data() const {
+  return entry_ == nullptr ? "" : reinterpret_cast<const char*>(entry_ + 1);
+}
+
+uint64_t InternedString::Hash() const {
+  return entry_ == nullptr ? 0 : entry_->hash;
+}
+
+InternedString::operator StringView() const { return {Data(), Size()}; }
+
+StringPool::StringPool() : current_(&AddTable(kInitialSlots)) {}
+
+// Entries are only reachable through the current table, which holds all.
+StringPool::~StringPool() {
+  const Table& table = *current_.load(std::memory_order_relaxed);
+  for (size_t index = 0; index <= table.mask; ++index) {
+    if (const Entry* entry = table.slots[index].entry.load(
+            std::memory_order_relaxed)) {
+      ::operator delete(const_cast<Entry*>(entry));
+    }
+  }
+}
+
+InternedString StringPool::Intern(StringView text) {
+  if (text.Empty()) {
+    return {};
+  }
+  uint64_t hash = SlotHash(text);
+  const Table* table = current_.load(std::memory_order_acquire);
+  if (const Entry* found = Lookup(*table, text, hash)) {
+    return InternedString(found);
+  }
+
+  std::lock_guard lock(mutex_);
+  table = current_.load(std::memory_order_relaxed);
+  if (const Entry* found = Lookup(*table, text, hash)) {
+    return InternedString(found);
+  }
+  if (2 * (size_.load(std::memory_order_relaxed) + 1) > table->mask + 1) {
+    table = &Grow();
   }
+  const Entry* entry = NewEntry(text, hash);
+  Insert(*table, entry);
+  size_.fetch_add(1, std::memory_order_relaxed);
 
-  for (size_t i = 0; i < lhs.Size(); ++i) {
-    if (lhs[i] != rhs[i]) {
+  return InternedString(entry);
+}
+
+bool StringPool::Find(StringView text, InternedString* interned) const {
+  if (text.Empty()) {
+    *interned = {};
+    return true;
+  }
+  uint64_t hash = SlotHash(text);
+  const Table* table = current_.load(std::memory_order_acquire);
+  const Entry* found = Lookup(*table, text, hash);
+  // A miss in a table that was replaced meanwhile may be stale.
+  for (const Table* probed = table; found == nullptr; probed = table) {
+    table = current_.load(std::memory_order_acquire);
+    if (table == probed) {
       return false;
     }
+    found = Lookup(*table, text, hash);
   }
+  *interned = InternedString(found);
 
   return true;
 }
 
-bool operator!=(const String& lhs, const String& rhs) { return !(lhs == rhs); }
-
-String operator*(const String& string, size_t count) {
-  String new_string = string;
-  new_string *= count;
+size_t StringPool::Size() const {
+  return size_.load(std::memory_order_relaxed);
+}
 
-  return new_string;
+uint64_t StringPool::SlotHash(StringView text) {
+  uint64_t hash = entrails::Hash(text);
+  return hash == 0 ? 1 : hash;
 }
 
-std::ostream& operator<<(std::ostream& ostream, const String& string) {
-  ostream << string.Data();
+const StringPool::Entry* StringPool::NewEntry(StringView text,
+                                              uint64_t hash) {
+  void* memory = ::operator new(sizeof(Entry) + text.Size() + 1);
+  auto* entry = new (memory) Entry{hash, text.Size()};
+  auto* data = reinterpret_cast<char*>(entry + 1);
+  std::memcpy(data, text.Data(), text.Size());
+  data[text.Size()] = '\0';
 
-  return ostream;
+  return entry;
 }
 
-std::istream& operator>>(std::istream& istream, String& string) {
-  std::istream::sentry sentry(istream);
+// The acquire load of a matching hash makes its entry visible.
+const StringPool::Entry* StringPool::Lookup(const Table& table,
+                                            StringView text, uint64_t hash) {
+  for (size_t index = hash & table.mask;; index = (index + 1) & table.mask) {
+    const Slot& slot = table.slots[index];
+    uint64_t slot_hash = slot.hash.load(std::memory_order_acquire);
+    if (slot_hash == 0) {
+      return nullptr;
+    }
+    if (slot_hash != hash) {
+      continue;
+    }
+    const Entry* entry = slot.entry.load(std::memory_order_relaxed);
+    if (entry->size == text.Size() &&
+        std::memcmp(entry + 1, text.Data(), text.Size()) == 0) {
+      return entry;
+    }
+  }
+}
 
-  if (!sentry) {
-    return istream;
+// Only called under the mutex, with a free slot guaranteed.
+void StringPool::Insert(const Table& table, const Entry* entry) {
+  size_t index = entry->hash & table.mask;
+  while (table.slots[index].hash.load(std::memory_order_relaxed) != 0) {
+    index = (index + 1) & table.mask;
   }
-  char buf;
-  while (istream.get(buf) && !entrails::Isspace(buf)) {
-    string.PushBack(buf);
+  table.slots[index].entry.store(entry, std::memory_order_relaxed);
+  table.slots[index].hash.store(entry->hash, std::memory_order_release);
+}
+
+const StringPool::Table& StringPool::AddTable(size_t slots) {
+  auto table = std::make_unique<Table>(Table{slots - 1, nullptr});
+  table->slots = std::make_unique<Slot[]>(slots);
+
+  return *tables_.emplace_back(std::move(table));
+}
+
+// Readers may still be probing the old table, so it is filled before the
+// new one is published and never freed before the pool.
+const StringPool::Table& StringPool::Grow() {
+  const Table& old = *current_.load(std::memory_order_relaxed);
+  const Table& grown = AddTable(2 * (old.mask + 1));
+  for (size_t index = 0; index <= old.mask; ++index) {
+    if (const Entry* entry = old.slots[index].entry.load(
+            std::memory_order_relaxed)) {
+      Insert(grown, entry);
+    }
   }
+  current_.store(&grown, std::memory_order_release);
 
-  return istream;
+  return grown;
 }
@@ -1,16 +1,352 @@
+#include <atomic>
+#include <climits>
+#include <compare>
+#include <concepts>
+#include <cstdint>
 #include <cstring>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-class String {
+class DoublingGrowth;
+
+template <typename Allocator, typename GrowthPolicy>
+class BasicString;
+
+// Non-owning (pointer, length) view of characters; it must not outlive them.
+class StringView {
+ public:
+  StringView() = default;
+  StringView(const char* data, size_t size);
+  StringView(const char* raw_string);
+  template <typename Allocator, typename GrowthPolicy>
+  StringView(const BasicString<Allocator, GrowthPolicy>& string);
+
+  bool Empty() const;
+  size_t Size() const;
+  const char* Data() const;
+  const char& operator[](size_t index) const;
+
+ private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Lazy range over the pieces of `text` between occurrences of `delim`.
+// Walking it allocates nothing; the pieces point into `text`.
+class SplitRange {
+ public:
+  class Iterator {
+   public:
+    // NOLINTBEGIN(readability-identifier-naming): std::iterator_traits names
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = StringView;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const StringView*;
+    using reference = const StringView&;
+    // NOLINTEND(readability-identifier-naming)
+
+    Iterator() = default;
+    Iterator(StringView text, StringView delim);
+
+    StringView operator*() const;
+    Iterator& operator++();
+    Iterator operator++(int);
+    bool operator==(const Iterator& other) const;
+
+   private:
+    StringView text_;
+    StringView delim_;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+    bool done_ = true;
+  };
+
+  SplitRange(StringView text, StringView delim);
+
+  Iterator begin() const;
+  Iterator end() const;
+
+ private:
+  StringView text_;
+  StringView delim_;
+};
+
+// Lazy range over the code points of UTF-8 text. A byte that does not
+// start a valid sequence comes out as U+FFFD and is skipped on its own.
+class CodePointRange {
+ public:
+  class Iterator {
+   public:
+    // NOLINTBEGIN(readability-identifier-naming): std::iterator_traits names
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = char32_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const char32_t*;
+    using reference = char32_t;
+    // NOLINTEND(readability-identifier-naming)
+
+    Iterator() = default;
+    Iterator(StringView text, size_t pos);
+
+    char32_t operator*() const;
+    Iterator& operator++();
+    Iterator operator++(int);
+    bool operator==(const Iterator& other) const;
+
+   private:
+    StringView text_;
+    size_t pos_ = 0;
+    size_t length_ = 0;
+    char32_t code_point_ = 0;
+
+    void Decode();
+  };
+
+  explicit CodePointRange(StringView text);
+
+  Iterator begin() const;
+  Iterator end() const;
+
+ private:
+  StringView text_;
+};
+
+std::ostream& operator<<(std::ostream& ostream, StringView view);
+
+// Allocator-independent kernels, compiled once in string.cpp.
+namespace entrails {
+inline constexpr size_t kNotFound = static_cast<size_t>(-1);
+
+inline size_t Max(size_t lhs, size_t rhs) { return lhs > rhs ? lhs : rhs; }
+
+inline size_t Min(size_t lhs, size_t rhs) { return lhs > rhs ? rhs : lhs; }
+
+bool Isspace(char symbol);
+int Compare(StringView lhs, StringView rhs);
+// Fast non-cryptographic 64-bit hash; not seeded, so not for untrusted keys.
+uint64_t Hash(StringView text);
+size_t Find(StringView text, StringView needle, size_t from);
+size_t RFind(StringView text, StringView needle, size_t from);
+size_t Count(StringView text, StringView needle);
+// Repeats data[0, filled) until data[0, total) is covered, doubling the
+// copied prefix each time.
+void FillRepeating(char* data, size_t filled, size_t total);
+const char* FindSpace(const char* begin, const char* end);
+
+// Length of the UTF-8 sequence at `pos`, or 0 if it is not a valid one, in
+// which case `code_point` is U+FFFD.
+size_t DecodeCodePoint(StringView text, size_t pos, char32_t* code_point);
+bool IsValidUtf8(StringView text);
+size_t CountCodePoints(StringView text);
+// Writes the folded text, never longer than `text`, to `out`; returns its
+// length.
+size_t FoldCase(StringView text, char* out);
+
+// Base 10 integers and the shortest text that parses back to the same
+// double, written to `out`; returns the length.
+inline constexpr size_t kMaxNumberLength = 32;
+size_t FormatNumber(int64_t value, char* out);
+size_t FormatNumber(uint64_t value, char* out);
+size_t FormatNumber(double value, char* out);
+// False, leaving `value` alone, unless all of `text` is the number and it
+// is in range.
+bool ParseNumber(StringView text, int64_t* value);
+bool ParseNumber(StringView text, uint64_t* value);
+bool ParseNumber(StringView text, double* value);
+
+template <typename T, typename... Excluded>
+concept NoneOf = (!std::same_as<std::remove_cv_t<T>, Excluded> && ...);
+
+// Integers that are numbers rather than flags or characters, and no wider
+// than the int64_t and uint64_t ParseNumber and FormatNumber work in.
+template <typename T>
+concept NumericInteger =
+    std::integral<T> && sizeof(T) <= sizeof(int64_t) &&
+    NoneOf<T, bool, char, wchar_t, char8_t, char16_t, char32_t>;
+
+template <typename Integer>
+using WideInteger =
+    std::conditional_t<std::is_signed_v<Integer>, int64_t, uint64_t>;
+
+// The get area pointers are protected; member pointers taken through a
+// derived class may still be applied to any std::streambuf.
+struct GetArea : std::streambuf {
+  static char* Begin(std::streambuf* buffer) {
+    return (buffer->*&GetArea::gptr)();
+  }
+  static char* End(std::streambuf* buffer) {
+    return (buffer->*&GetArea::egptr)();
+  }
+  static void Advance(std::streambuf* buffer, int count) {
+    (buffer->*&GetArea::gbump)(count);
+  }
+};
+
+// Falls back to one character at a time for unbuffered streams.
+template <typename StringType>
+bool ExtractUnbuffered(std::streambuf* buffer, StringType& string) {
+  auto next = static_cast<char>(buffer->sgetc());
+  if (Isspace(next)) {
+    return true;
+  }
+  string.PushBack(next);
+  buffer->sbumpc();
+  return false;
+}
+
+// Appends the token's prefix in each get area and refills it until the
+// token ends; returns the state bits to set on the stream.
+template <typename StringType>
+std::ios_base::iostate ExtractToken(std::streambuf* buffer,
+                                    StringType& string) {
+  while (true) {
+    if (GetArea::Begin(buffer) == GetArea::End(buffer)) {
+      if (buffer->sgetc() == std::streambuf::traits_type::eof()) {
+        return std::ios_base::eofbit;
+      }
+      if (GetArea::Begin(buffer) == GetArea::End(buffer)) {
+        if (ExtractUnbuffered(buffer, string)) {
+          return std::ios_base::goodbit;
+        }
+        continue;
+      }
+    }
+    const char* begin = GetArea::Begin(buffer);
+    size_t available = GetArea::End(buffer) - begin;
+    const char* end = begin + Min(available, INT_MAX);
+    const char* stop = FindSpace(begin, end);
+
+    string.Append({begin, static_cast<size_t>(stop - begin)});
+    GetArea::Advance(buffer, static_cast<int>(stop - begin));
+    if (stop != end) {
+      return std::ios_base::goodbit;
+    }
+  }
+}
+}  // namespace entrails
+
+// Totals over the buffers of the strings whose growth policy is a
+// CountingGrowth; other strings never touch the shared counters. The
+// counters are relaxed, so a snapshot taken while other threads allocate is
+// only approximately consistent.
+struct StringMemoryStats {
+  size_t allocations;
+  size_t deallocations;
+  // Buffers replaced while holding characters, which had to be copied.
+  size_t reallocations;
+  size_t allocated_bytes;
+  size_t live_bytes;
+};
+
+StringMemoryStats GetStringMemoryStats();
+void ResetStringMemoryStats();
+
+namespace entrails {
+struct MemoryCounters {
+  std::atomic<size_t> allocations;
+  std::atomic<size_t> deallocations;
+  std::atomic<size_t> reallocations;
+  std::atomic<size_t> allocated_bytes;
+  std::atomic<size_t> live_bytes;
+};
+
+inline MemoryCounters memory_counters;
+
+template <typename GrowthPolicy>
+concept CountsMemory = requires { requires GrowthPolicy::kCountsMemory; };
+
+inline void CountAllocation(size_t bytes) {
+  memory_counters.allocations.fetch_add(1, std::memory_order_relaxed);
+  memory_counters.allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  memory_counters.live_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+inline void CountDeallocation(size_t bytes) {
+  memory_counters.deallocations.fetch_add(1, std::memory_order_relaxed);
+  memory_counters.live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+inline void CountReallocation() {
+  memory_counters.reallocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t SizeClass(size_t bytes);
+}  // namespace entrails
+
+// Growth policies decide the capacity a string grows to when appending
+// outgrows it (Grow) and round every heap capacity it asks for (Fit).
+// Capacities exclude the terminator, which takes one more byte.
+class DoublingGrowth {
  public:
-  String() = default;
-  String(size_t size, char character);
-  String(const char* raw_string);
+  static size_t Grow(size_t capacity, size_t required) {
+    return entrails::Max(required, 2 * capacity);
+  }
+  static size_t Fit(size_t capacity) { return capacity; }
+};
+
+// Lets a buffer be rebuilt in memory freed by its earlier, smaller ones.
+class OneAndHalfGrowth {
+ public:
+  static size_t Grow(size_t capacity, size_t required) {
+    return entrails::Max(required, capacity + capacity / 2);
+  }
+  static size_t Fit(size_t capacity) { return capacity; }
+};
+
+// Grows by 1.5x and rounds allocations up to jemalloc's size classes, so
+// the slack the allocator would hand out anyway becomes usable capacity.
+class SizeClassGrowth {
+ public:
+  static size_t Grow(size_t capacity, size_t required) {
+    return entrails::Max(required, capacity + capacity / 2);
+  }
+  static size_t Fit(size_t capacity) {
+    return entrails::SizeClass(capacity + 1) - 1;
+  }
+};
+
+// Grows like Base and reports every buffer to GetStringMemoryStats.
+template <typename Base = DoublingGrowth>
+class CountingGrowth : public Base {
+ public:
+  static constexpr bool kCountsMemory = true;
+};
+
+// Characters are allocated through std::allocator_traits<Allocator>, which
+// must hand out plain char pointers; GrowthPolicy is one of the above.
+template <typename Allocator = std::allocator<char>,
+          typename GrowthPolicy = DoublingGrowth>
+class BasicString {
+  using AllocTraits = std::allocator_traits<Allocator>;
+
+  static constexpr bool kNothrowMoveAssign =
+      AllocTraits::propagate_on_container_move_assignment::value ||
+      AllocTraits::is_always_equal::value;
+  static constexpr bool kCountsMemory = entrails::CountsMemory<GrowthPolicy>;
+
+ public:
+  static constexpr size_t kNpos = entrails::kNotFound;
+
+  BasicString() = default;
+  explicit BasicString(const Allocator& alloc);
+  BasicString(size_t size, char character,
+              const Allocator& alloc = Allocator());
+  BasicString(const char* raw_string, const Allocator& alloc = Allocator());
+  explicit BasicString(StringView view, const Allocator& alloc = Allocator());
 
-  String(const String&);
-  String& operator=(const String& other);
-  ~String();
+  BasicString(const BasicString& other);
+  BasicString(BasicString&& other) noexcept;
+  BasicString& operator=(const BasicString& other);
+  BasicString& operator=(BasicString&& other) noexcept(kNothrowMoveAssign);
+  ~BasicString();
+
+  Allocator GetAllocator() const;
 
   void PushBack(char character);
   void PopBack();
@@ -27,7 +363,7 @@ class String {
   void Resize(size_t new_size, char character);
   void Reserve(size_t new_cap);
   void ShrinkToFit();
-  void Swap(String& other);
+  void Swap(BasicString& other);
 
   bool Empty() const;
   size_t Size() const;
@@ -35,28 +371,948 @@ class String {
   char* Data();
   const char* Data() const;
 
-  std::vector<String> Split(const String& delim = " ");
-  String Join(const std::vector<String>& strings) const;
+  // Negative, zero or positive as *this orders before, equal to or after
+  // `other`; all comparison operators are built on it.
+  int Compare(StringView other) const;
+
+  // Positions are those of the first character; kNpos when there is no
+  // match. Count counts non-overlapping occurrences.
+  size_t Find(StringView needle, size_t from = 0) const;
+  size_t RFind(StringView needle, size_t from = kNpos) const;
+  size_t Count(StringView needle) const;
+
+  // UTF-8. Overlong forms, surrogates and code points past U+10FFFF are
+  // invalid. CodePointCount counts the bytes that are not continuation
+  // bytes, which for valid text is the number of code points.
+  bool IsValidUtf8() const;
+  size_t CodePointCount() const;
+  CodePointRange CodePoints() const;
+  // Simple case folding of ASCII, Latin-1, Latin Extended-A, Greek and
+  // Coptic, Cyrillic and Cyrillic Supplement; anything else, Latin
+  // Extended-B and invalid bytes included, is copied as is.
+  BasicString FoldCase() const;
+
+  // Base 10 without a leading '+' or spaces; false, leaving `value` alone,
+  // unless the whole string is a number that fits. Nothing allocates.
+  template <entrails::NumericInteger Integer>
+  bool ParseInt(Integer* value) const;
+  bool ParseDouble(double* value) const;
+  // Doubles are written as the shortest text that parses back to them.
+  // bool and the character types would otherwise convert to double.
+  template <entrails::NumericInteger Integer>
+  BasicString& AppendNumber(Integer value);
+  BasicString& AppendNumber(double value);
+  template <std::integral NotNumber>
+    requires(!entrails::NumericInteger<NotNumber>)
+  BasicString& AppendNumber(NotNumber value) = delete;
+
+  std::vector<BasicString> Split(const BasicString& delim = " ") const;
+  SplitRange SplitView(StringView delim = " ") const;
+  template <typename Callback>
+  void ForEachSplit(StringView delim, Callback callback) const;
+  BasicString Join(const std::vector<BasicString>& strings) const;
+  // Elements are anything convertible to StringView; two passes, so the
+  // iterators must be at least forward ones.
+  template <typename Iterator>
+  BasicString Join(Iterator first, Iterator last) const;
+  template <typename Range>
+  BasicString Join(const Range& range) const;
+
+  BasicString& Append(StringView view);
+
+  BasicString& operator+=(const BasicString& other);
+  BasicString& operator*=(size_t count);
+
+  // Hidden friends, so that either side may still convert from const char*.
+  friend BasicString operator+(const BasicString& lhs,
+                               const BasicString& rhs) {
+    return Concat(lhs, rhs);
+  }
+  friend BasicString operator+(BasicString&& lhs, const BasicString& rhs) {
+    BasicString new_string = std::move(lhs);
+    new_string += rhs;
+    return new_string;
+  }
+  friend BasicString operator*(const BasicString& string, size_t count) {
+    BasicString new_string = string;
+    new_string *= count;
+    return new_string;
+  }
 
-  String& operator+=(const String& other);
-  String& operator*=(size_t count);
+  friend bool operator>(const BasicString& lhs, const BasicString& rhs) {
+    return lhs.Compare(rhs) > 0;
+  }
+  friend bool operator>=(const BasicString& lhs, const BasicString& rhs) {
+    return lhs.Compare(rhs) >= 0;
+  }
+  friend bool operator<(const BasicString& lhs, const BasicString& rhs) {
+    return lhs.Compare(rhs) < 0;
+  }
+  friend bool operator<=(const BasicString& lhs, const BasicString& rhs) {
+    return lhs.Compare(rhs) <= 0;
+  }
+  friend bool operator==(const BasicString& lhs, const BasicString& rhs) {
+    return lhs.Size() == rhs.Size() &&
+           (lhs.Empty() ||
+            std::memcmp(lhs.Data(), rhs.Data(), lhs.Size()) == 0);
+  }
+  friend bool operator!=(const BasicString& lhs, const BasicString& rhs) {
+    return !(lhs == rhs);
+  }
+
+  friend std::ostream& operator<<(std::ostream& ostream,
+                                  const BasicString& string) {
+    return ostream << string.Data();
+  }
+  friend std::istream& operator>>(std::istream& istream, BasicString& string) {
+    return string.ReadToken(istream);
+  }
 
  private:
-  size_t size_ = 0;
-  size_t capacity_ = 0;
-  char* characters_ = nullptr;
+  // Strings of up to kSmallCapacity characters live inside the object. The
+  // last byte is shared: it is the short size for small strings and the top
+  // byte of the heap capacity, tagged with kLargeTag, for large ones.
+  struct Large {
+    char* data;
+    size_t size;
+    size_t capacity;
+  };
+
+  static constexpr size_t kSmallCapacity = sizeof(Large) - 2;
+  static constexpr unsigned char kLargeTag = 1U << (CHAR_BIT - 1);
+  static constexpr size_t kLargeFlag = size_t{kLargeTag}
+                                       << (CHAR_BIT * (sizeof(size_t) - 1));
+
+  struct Small {
+    char data[kSmallCapacity + 1];
+    unsigned char size;
+  };
+
+  union Storage {
+    Small small;
+    Large large;
+  };
+
+  static_assert(std::is_same_v<typename AllocTraits::pointer, char*>);
+
+  Storage storage_{};
+  [[no_unique_address]] Allocator alloc_{};
 
+  bool IsSmall() const;
+  void SetSize(size_t size);
+  void Reallocate(size_t new_cap);
+  char* Allocate(size_t new_cap);
+  void Deallocate();
   void SetNullSymbol(size_t index);
+  void SwapStorage(BasicString& other);
+  void CopyFrom(StringView view);
+  std::istream& ReadToken(std::istream& istream);
+
+  static BasicString Concat(const BasicString& lhs, const BasicString& rhs);
 };
 
-String operator+(const String& lhs, const String& rhs);
-bool operator>(const String& lhs, const String& rhs);
-bool operator>=(const String& lhs, const String& rhs);
-bool operator<(const String& lhs, const String& rhs);
-bool operator<=(const String& lhs, const String& rhs);
-bool operator==(const String& lhs, const String& rhs);
-bool operator!=(const String& lhs, const String& rhs);
-String operator*(const String& string, size_t count);
+using String = BasicString<>;
+
+extern template class BasicString<std::allocator<char>>;
+
+template <typename Allocator, typename GrowthPolicy>
+StringView::StringView(const BasicString<Allocator, GrowthPolicy>& string)
+    : data_(string.Data()), size_(string.Size()) {}
+
+template <typename Allocator, typename GrowthPolicy>
+BasicString<Allocator, GrowthPolicy>::BasicString(const Allocator& alloc)
+    : alloc_(alloc) {}
+
+template <typename Allocator, typename GrowthPolicy>
+BasicString<Allocator, GrowthPolicy>::BasicString(size_t size, char character,
+                                                  const Allocator& alloc)
+    : alloc_(alloc) {
+  Reallocate(size);
+  std::memset(Data(), character, size);
+  SetSize(size);
+}
+
+template <typename Allocator, typename GrowthPolicy>
+BasicString<Allocator, GrowthPolicy>::BasicString(const char* raw_string,
+                                                  const Allocator& alloc)
+    : BasicString(StringView(raw_string), alloc) {}
+
+template <typename Allocator, typename GrowthPolicy>
+BasicString<Allocator, GrowthPolicy>::BasicString(StringView view,
+                                                  const Allocator& alloc)
+    : alloc_(alloc) {
+  Reallocate(view.Size());
+  if (!view.Empty()) {
+    std::memcpy(Data(), view.Data(), view.Size());
+  }
+  SetSize(view.Size());
+}
+
+template <typename Allocator, typename GrowthPolicy>
+BasicString<Allocator, GrowthPolicy>::~BasicString() { Deallocate(); }
+
+template <typename Allocator, typename GrowthPolicy>
+BasicString<Allocator, GrowthPolicy>::BasicString(const BasicString& other)
+    : BasicString(
+          StringView(other),
+          AllocTraits::select_on_container_copy_construction(other.alloc_)) {}
+
+template <typename Allocator, typename GrowthPolicy>
+BasicString<Allocator, GrowthPolicy>::BasicString(BasicString&& other) noexcept
+    : storage_(other.storage_), alloc_(std::move(other.alloc_)) {
+  other.storage_ = Storage{};
+}
+
+template <typename Allocator, typename GrowthPolicy>
+BasicString<Allocator, GrowthPolicy>&
+BasicString<Allocator, GrowthPolicy>::operator=(const BasicString& other) {
+  if (this == &other) {
+    return *this;
+  }
+  if constexpr (AllocTraits::propagate_on_container_copy_assignment::value) {
+    if (alloc_ != other.alloc_) {
+      Deallocate();
+      storage_ = Storage{};
+    }
+    alloc_ = other.alloc_;
+  }
+  CopyFrom(other);
+
+  return *this;
+}
+
+// Steals the buffer unless it came from an allocator that is not ours and
+// may not become ours, in which case the characters are copied.
+template <typename Allocator, typename GrowthPolicy>
+BasicString<Allocator, GrowthPolicy>&
+BasicString<Allocator, GrowthPolicy>::operator=(BasicString&& other) noexcept(
+    kNothrowMoveAssign) {
+  if (this == &other) {
+    return *this;
+  }
+  if constexpr (!AllocTraits::propagate_on_container_move_assignment::value) {
+    if (alloc_ != other.alloc_) {
+      CopyFrom(other);
+      return *this;
+    }
+  }
+
+  Deallocate();
+  if constexpr (AllocTraits::propagate_on_container_move_assignment::value) {
+    alloc_ = std::move(other.alloc_);
+  }
+  storage_ = other.storage_;
+  other.storage_ = Storage{};
+
+  return *this;
+}
+
+template <typename Allocator, typename GrowthPolicy>
+Allocator BasicString<Allocator, GrowthPolicy>::GetAllocator() const {
+  return alloc_;
+}
+
+template <typename Allocator, typename GrowthPolicy>
+void BasicString<Allocator, GrowthPolicy>::Clear() { SetSize(0); }
+
+template <typename Allocator, typename GrowthPolicy>
+void BasicString<Allocator, GrowthPolicy>::PushBack(char character) {
+  if (Size() == Capacity()) {
+    Reallocate(GrowthPolicy::Grow(Capacity(), Size() + 1));
+  }
+
+  Data()[Size()] = character;
+  SetSize(Size() + 1);
+}
+
+template <typename Allocator, typename GrowthPolicy>
+void BasicString<Allocator, GrowthPolicy>::PopBack() {
+  if (Empty()) {
+    return;
+  }
+  SetSize(Size() - 1);
+}
+
+template <typename Allocator, typename GrowthPolicy>
+void BasicString<Allocator, GrowthPolicy>::Resize(size_t new_size) {
+  if (new_size > Capacity()) {
+    Reallocate(GrowthPolicy::Grow(Capacity(), new_size));
+  }
+
+  SetSize(new_size);
+}
+
+template <typename Allocator, typename GrowthPolicy>
+void BasicString<Allocator, GrowthPolicy>::Reserve(size_t new_cap) {
+  if (new_cap <= Capacity()) {
+    return;
+  }
+
+  Reallocate(new_cap);
+}
+
+template <typename Allocator, typename GrowthPolicy>
+void BasicString<Allocator, GrowthPolicy>::Resize(size_t new_size,
+                                                  char character) {
+  size_t prev_size = Size();
+  Resize(new_size);
+  if (new_size > prev_size) {
+    std::memset(Data() + prev_size, character, new_size - prev_size);
+  }
+}
+
+template <typename Allocator, typename GrowthPolicy>
+void BasicString<Allocator, GrowthPolicy>::ShrinkToFit() {
+  if (IsSmall()) {
+    return;
+  }
+  size_t fitted = Size() > kSmallCapacity ? GrowthPolicy::Fit(Size()) : Size();
+  if (fitted < Capacity()) {
+    Reallocate(fitted);
+  }
+}
+
+template <typename Allocator, typename GrowthPolicy>
+void BasicString<Allocator, GrowthPolicy>::Swap(BasicString& other) {
+  if constexpr (AllocTraits::propagate_on_container_swap::value) {
+    using std::swap;
+    swap(alloc_, other.alloc_);
+  }
+  SwapStorage(other);
+}
+
+template <typename Allocator, typename GrowthPolicy>
+char& BasicString<Allocator, GrowthPolicy>::Front() { return Data()[0]; }
+
+template <typename Allocator, typename GrowthPolicy>
+char& BasicString<Allocator, GrowthPolicy>::Back() {
+  return Data()[Size() - 1];
+}
+
+template <typename Allocator, typename GrowthPolicy>
+const char& BasicString<Allocator, GrowthPolicy>::Front() const {
+  return Data()[0];
+}
 
-std::ostream& operator<<(std::ostream& ostream, const String& string);
-std::istream& operator>>(std::istream& istream, String& string);
+template <typename Allocator, typename GrowthPolicy>
+const char& BasicString<Allocator, GrowthPolicy>::Back() const {
+  return Data()[Size() - 1];
+}
+
+template <typename Allocator, typename GrowthPolicy>
+bool BasicString<Allocator, GrowthPolicy>::Empty() const { return Size() == 0; }
+
+template <typename Allocator, typename GrowthPolicy>
+size_t BasicString<Allocator, GrowthPolicy>::Size() const {
+  return IsSmall() ? storage_.small.size : storage_.large.size;
+}
+
+template <typename Allocator, typename GrowthPolicy>
+size_t BasicString<Allocator, GrowthPolicy>::Capacity() const {
+  return IsSmall() ? kSmallCapacity : storage_.large.capacity & ~kLargeFlag;
+}
+
+template <typename Allocator, typename GrowthPolicy>
+char* BasicString<Allocator, GrowthPolicy>::Data() {
+  return IsSmall() ? storage_.small.data : storage_.large.data;
+}
+
+template <typename Allocator, typename GrowthPolicy>
+const char* BasicString<Allocator, GrowthPolicy>::Data() const {
+  return IsSmall() ? storage_.small.data : storage_.large.data;
+}
+
+template <typename Allocator, typename GrowthPolicy>
+char& BasicString<Allocator, GrowthPolicy>::operator[](size_t index) {
+  return Data()[index];
+}
+
+template <typename Allocator, typename GrowthPolicy>
+const char& BasicString<Allocator, GrowthPolicy>::operator[](
+    size_t index) const {
+  return Data()[index];
+}
+
+template <typename Allocator, typename GrowthPolicy>
+void BasicString<Allocator, GrowthPolicy>::SetNullSymbol(size_t index) {
+  Data()[index] = '\0';
+}
+
+template <typename Allocator, typename GrowthPolicy>
+bool BasicString<Allocator, GrowthPolicy>::IsSmall() const {
+  return (storage_.small.size & kLargeTag) == 0;
+}
+
+template <typename Allocator, typename GrowthPolicy>
+void BasicString<Allocator, GrowthPolicy>::SetSize(size_t size) {
+  if (IsSmall()) {
+    storage_.small.size = static_cast<unsigned char>(size);
+  } else {
+    storage_.large.size = size;
+  }
+  SetNullSymbol(size);
+}
+
+// Moves the characters into a buffer for `new_cap` characters plus the
+// terminator, rounded up by the growth policy, going back inside the
+// object when they fit there.
+template <typename Allocator, typename GrowthPolicy>
+void BasicString<Allocator, GrowthPolicy>::Reallocate(size_t new_cap) {
+  Storage storage{};
+  char* new_data = storage.small.data;
+  if (new_cap > kSmallCapacity) {
+    new_cap = GrowthPolicy::Fit(new_cap);
+    new_data = Allocate(new_cap);
+    storage.large = {new_data, Size(), new_cap | kLargeFlag};
+  } else {
+    storage.small.size = static_cast<unsigned char>(Size());
+  }
+  if (kCountsMemory && !Empty()) {
+    entrails::CountReallocation();
+  }
+
+  std::memcpy(new_data, Data(), Size() + 1);
+  Deallocate();
+  storage_ = storage;
+}
+
+template <typename Allocator, typename GrowthPolicy>
+char* BasicString<Allocator, GrowthPolicy>::Allocate(size_t new_cap) {
+  char* data = AllocTraits::allocate(alloc_, new_cap + 1);
+  if constexpr (kCountsMemory) {
+    entrails::CountAllocation(new_cap + 1);
+  }
+
+  return data;
+}
+
+template <typename Allocator, typename GrowthPolicy>
+void BasicString<Allocator, GrowthPolicy>::Deallocate() {
+  if (!IsSmall()) {
+    AllocTraits::deallocate(alloc_, storage_.large.data, Capacity() + 1);
+    if constexpr (kCountsMemory) {
+      entrails::CountDeallocation(Capacity() + 1);
+    }
+  }
+}
+
+// Only valid when both strings allocate through equal allocators.
+template <typename Allocator, typename GrowthPolicy>
+void BasicString<Allocator, GrowthPolicy>::SwapStorage(BasicString& other) {
+  Storage temp = other.storage_;
+  other.storage_ = storage_;
+  storage_ = temp;
+}
+
+// Reuses the buffer when the characters fit; `view` must not point into it.
+template <typename Allocator, typename GrowthPolicy>
+void BasicString<Allocator, GrowthPolicy>::CopyFrom(StringView view) {
+  if (view.Size() > Capacity()) {
+    BasicString copy(view, alloc_);
+    SwapStorage(copy);
+    return;
+  }
+
+  if (!view.Empty()) {
+    std::memcpy(Data(), view.Data(), view.Size());
+  }
+  SetSize(view.Size());
+}
+
+template <typename Allocator, typename GrowthPolicy>
+int BasicString<Allocator, GrowthPolicy>::Compare(StringView other) const {
+  return entrails::Compare(*this, other);
+}
+
+template <typename Allocator, typename GrowthPolicy>
+size_t BasicString<Allocator, GrowthPolicy>::Find(StringView needle,
+                                                  size_t from) const {
+  return entrails::Find(*this, needle, from);
+}
+
+template <typename Allocator, typename GrowthPolicy>
+size_t BasicString<Allocator, GrowthPolicy>::RFind(StringView needle,
+                                                   size_t from) const {
+  return entrails::RFind(*this, needle, from);
+}
+
+template <typename Allocator, typename GrowthPolicy>
+size_t BasicString<Allocator, GrowthPolicy>::Count(StringView needle) const {
+  return entrails::Count(*this, needle);
+}
+
+template <typename Allocator, typename GrowthPolicy>
+bool BasicString<Allocator, GrowthPolicy>::IsValidUtf8() const {
+  return entrails::IsValidUtf8(*this);
+}
+
+template <typename Allocator, typename GrowthPolicy>
+size_t BasicString<Allocator, GrowthPolicy>::CodePointCount() const {
+  return entrails::CountCodePoints(*this);
+}
+
+template <typename Allocator, typename GrowthPolicy>
+CodePointRange BasicString<Allocator, GrowthPolicy>::CodePoints() const {
+  return CodePointRange(*this);
+}
+
+template <typename Allocator, typename GrowthPolicy>
+BasicString<Allocator, GrowthPolicy>
+BasicString<Allocator, GrowthPolicy>::FoldCase() const {
+  BasicString folded(
+      AllocTraits::select_on_container_copy_construction(alloc_));
+  folded.Reserve(Size());
+  folded.SetSize(entrails::FoldCase(*this, folded.Data()));
+
+  return folded;
+}
+
+template <typename Allocator, typename GrowthPolicy>
+template <entrails::NumericInteger Integer>
+bool BasicString<Allocator, GrowthPolicy>::ParseInt(Integer* value) const {
+  entrails::WideInteger<Integer> wide = 0;
+  if (!entrails::ParseNumber(*this, &wide) || !std::in_range<Integer>(wide)) {
+    return false;
+  }
+  *value = static_cast<Integer>(wide);
+  return true;
+}
+
+template <typename Allocator, typename GrowthPolicy>
+bool BasicString<Allocator, GrowthPolicy>::ParseDouble(double* value) const {
+  return entrails::ParseNumber(*this, value);
+}
+
+template <typename Allocator, typename GrowthPolicy>
+template <entrails::NumericInteger Integer>
+BasicString<Allocator, GrowthPolicy>&
+BasicString<Allocator, GrowthPolicy>::AppendNumber(Integer value) {
+  using Wide = entrails::WideInteger<Integer>;
+  char buffer[entrails::kMaxNumberLength];
+  size_t length = entrails::FormatNumber(static_cast<Wide>(value), buffer);
+  return Append({buffer, length});
+}
+
+template <typename Allocator, typename GrowthPolicy>
+BasicString<Allocator, GrowthPolicy>&
+BasicString<Allocator, GrowthPolicy>::AppendNumber(double value) {
+  char buffer[entrails::kMaxNumberLength];
+  return Append({buffer, entrails::FormatNumber(value, buffer)});
+}
+
+template <typename Allocator, typename GrowthPolicy>
+std::vector<BasicString<Allocator, GrowthPolicy>>
+BasicString<Allocator, GrowthPolicy>::Split(const BasicString& delim) const {
+  std::vector<BasicString> substrings;
+  for (StringView piece : SplitView(delim)) {
+    substrings.emplace_back(piece, alloc_);
+  }
+
+  return substrings;
+}
+
+template <typename Allocator, typename GrowthPolicy>
+SplitRange BasicString<Allocator, GrowthPolicy>::SplitView(
+    StringView delim) const {
+  return {*this, delim};
+}
+
+template <typename Allocator, typename GrowthPolicy>
+template <typename Callback>
+void BasicString<Allocator, GrowthPolicy>::ForEachSplit(
+    StringView delim, Callback callback) const {
+  for (StringView piece : SplitView(delim)) {
+    callback(piece);
+  }
+}
+
+template <typename Allocator, typename GrowthPolicy>
+BasicString<Allocator, GrowthPolicy> BasicString<Allocator, GrowthPolicy>::Join(
+    const std::vector<BasicString>& strings) const {
+  return Join(strings.begin(), strings.end());
+}
+
+template <typename Allocator, typename GrowthPolicy>
+template <typename Iterator>
+BasicString<Allocator, GrowthPolicy> BasicString<Allocator, GrowthPolicy>::Join(
+    Iterator first, Iterator last) const {
+  BasicString joined(alloc_);
+  if (first == last) {
+    return joined;
+  }
+  size_t total = 0;
+  for (Iterator iter = first; iter != last; ++iter) {
+    total += StringView(*iter).Size() + Size();
+  }
+  joined.Reserve(total - Size());
+
+  joined.Append(*first);
+  for (++first; first != last; ++first) {
+    joined.Append(*this);
+    joined.Append(*first);
+  }
+
+  return joined;
+}
+
+template <typename Allocator, typename GrowthPolicy>
+template <typename Range>
+BasicString<Allocator, GrowthPolicy> BasicString<Allocator, GrowthPolicy>::Join(
+    const Range& range) const {
+  return Join(std::begin(range), std::end(range));
+}
+
+template <typename Allocator, typename GrowthPolicy>
+BasicString<Allocator, GrowthPolicy>&
+BasicString<Allocator, GrowthPolicy>::Append(StringView view) {
+  if (view.Empty()) {
+    return *this;
+  }
+  size_t new_size = Size() + view.Size();
+  if (new_size > Capacity()) {
+    // Fill the new buffer before the old one goes: `view` may point into it.
+    BasicString grown(alloc_);
+    grown.Reallocate(GrowthPolicy::Grow(Capacity(), new_size));
+    if (kCountsMemory && !Empty()) {
+      entrails::CountReallocation();
+    }
+    std::memcpy(grown.Data(), Data(), Size());
+    std::memcpy(grown.Data() + Size(), view.Data(), view.Size());
+    grown.SetSize(new_size);
+    SwapStorage(grown);
+    return *this;
+  }
+
+  std::memcpy(Data() + Size(), view.Data(), view.Size());
+  SetSize(new_size);
+
+  return *this;
+}
+
+template <typename Allocator, typename GrowthPolicy>
+BasicString<Allocator, GrowthPolicy>&
+BasicString<Allocator, GrowthPolicy>::operator+=(const BasicString& other) {
+  return Append(other);
+}
+
+// Fills the result by copying the already repeated prefix onto its end, so
+// a repeat takes one allocation and about log2(count) memcpy calls.
+template <typename Allocator, typename GrowthPolicy>
+BasicString<Allocator, GrowthPolicy>&
+BasicString<Allocator, GrowthPolicy>::operator*=(size_t count) {
+  if (count == 0 || Empty()) {
+    Clear();
+    return *this;
+  }
+  size_t total = Size() * count;
+  if (total > Capacity()) {
+    Reallocate(total);
+  }
+
+  entrails::FillRepeating(Data(), Size(), total);
+  SetSize(total);
+
+  return *this;
+}
+
+template <typename Allocator, typename GrowthPolicy>
+BasicString<Allocator, GrowthPolicy>
+BasicString<Allocator, GrowthPolicy>::Concat(const BasicString& lhs,
+                                             const BasicString& rhs) {
+  BasicString new_string(
+      AllocTraits::select_on_container_copy_construction(lhs.alloc_));
+  new_string.Reserve(lhs.Size() + rhs.Size());
+
+  new_string += lhs;
+  new_string += rhs;
+
+  return new_string;
+}
+
+// Like std::string's: replaces the contents with the next token and leaves
+// the whitespace after it in the stream.
+template <typename Allocator, typename GrowthPolicy>
+std::istream& BasicString<Allocator, GrowthPolicy>::ReadToken(
+    std::istream& istream) {
+  std::istream::sentry sentry(istream);
+
+  if (!sentry) {
+    return istream;
+  }
+  Clear();
+  std::ios_base::iostate state =
+      entrails::ExtractToken(istream.rdbuf(), *this);
+  if (Empty()) {
+    state |= std::ios_base::failbit;
+  }
+  istream.width(0);
+  istream.setstate(state);
+
+  return istream;
+}
+
+// Immutable string whose copies and slices share one reference-counted
+// buffer: copying is an atomic increment, Substr is O(1). The characters
+// of a slice are not null-terminated.
+class SharedString {
+ public:
+  SharedString() = default;
+  explicit SharedString(StringView view);
+  SharedString(const SharedString& other) noexcept;
+  SharedString(SharedString&& other) noexcept;
+  SharedString& operator=(const SharedString& other) noexcept;
+  SharedString& operator=(SharedString&& other) noexcept;
+  ~SharedString();
+
+  bool Empty() const;
+  size_t Size() const;
+  const char* Data() const;
+  const char& operator[](size_t index) const;
+  // Number of SharedStrings sharing the buffer; 0 for an empty one.
+  size_t UseCount() const;
+
+  // Clamps like std::string::substr, without throwing.
+  SharedString Substr(size_t pos, size_t count = entrails::kNotFound) const;
+  int Compare(StringView other) const;
+  void Swap(SharedString& other) noexcept;
+
+  operator StringView() const;
+
+  friend bool operator==(const SharedString& lhs, const SharedString& rhs) {
+    return lhs.Compare(rhs) == 0;
+  }
+  friend bool operator==(const SharedString& lhs, StringView rhs) {
+    return lhs.Compare(rhs) == 0;
+  }
+  friend std::strong_ordering operator<=>(const SharedString& lhs,
+                                          const SharedString& rhs) {
+    return lhs.Compare(rhs) <=> 0;
+  }
+  friend std::strong_ordering operator<=>(const SharedString& lhs,
+                                          StringView rhs) {
+    return lhs.Compare(rhs) <=> 0;
+  }
+  friend std::ostream& operator<<(std::ostream& ostream,
+                                  const SharedString& string) {
+    return ostream << StringView(string);
+  }
+
+ private:
+  // Allocated together with the characters, which follow it.
+  struct Block {
+    std::atomic<size_t> references;
+  };
+
+  Block* block_ = nullptr;
+  const char* data_ = "";
+  size_t size_ = 0;
+
+  void Release();
+};
+
+// Collects the pieces of a large output and copies them only once, into a
+// single exact-size String or straight to a file descriptor with writev.
+// Strings the caller keeps are referred to, not copied. Views and
+// temporaries are copied into chunks that are never reallocated, so a piece
+// stays where it was put; adjacent pieces of a chunk are merged.
+class StringBuilder {
+ public:
+  StringBuilder() = default;
+  StringBuilder(const StringBuilder& other) = delete;
+  StringBuilder(StringBuilder&& other) noexcept;
+  StringBuilder& operator=(const StringBuilder& other) = delete;
+  StringBuilder& operator=(StringBuilder&& other) noexcept;
+  ~StringBuilder() = default;
+
+  // Copies the characters.
+  StringBuilder& Append(StringView view);
+  // Copies nothing: `string` must outlive the builder unchanged.
+  template <typename Allocator, typename GrowthPolicy>
+  StringBuilder& Append(const BasicString<Allocator, GrowthPolicy>& string);
+  // A temporary is gone before the output is built, so it is copied.
+  template <typename Allocator, typename GrowthPolicy>
+  StringBuilder& Append(BasicString<Allocator, GrowthPolicy>&& string);
+  // Keeps a reference to the buffer instead of copying it.
+  StringBuilder& Append(const SharedString& string);
+  // Copies nothing: the characters must outlive the builder.
+  StringBuilder& AppendView(StringView view);
+  // Stores at most one chunk of repetitions and refers to it repeatedly.
+  StringBuilder& AppendRepeat(StringView view, size_t count);
+  template <typename Range>
+  StringBuilder& Join(const Range& range, StringView delim);
+
+  bool Empty() const;
+  size_t Size() const;
+  size_t PieceCount() const;
+  template <typename Callback>
+  void ForEachPiece(Callback callback) const;
+
+  template <typename Allocator = std::allocator<char>>
+  BasicString<Allocator> Build(const Allocator& alloc = Allocator()) const;
+  // Writes every piece with as few writev calls as possible, resuming after
+  // partial writes and EINTR; false with errno set on any other failure.
+  bool WriteTo(int fd) const;
+
+  friend std::ostream& operator<<(std::ostream& ostream,
+                                  const StringBuilder& builder) {
+    builder.ForEachPiece([&ostream](StringView piece) { ostream << piece; });
+    return ostream;
+  }
+
+ private:
+  static constexpr size_t kMinChunk = size_t{1} << 10;
+  static constexpr size_t kMaxChunk = size_t{1} << 16;
+
+  std::vector<StringView> pieces_;
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  std::vector<SharedString> shared_;
+  char* free_ = nullptr;
+  size_t free_size_ = 0;
+  size_t size_ = 0;
+
+  char* Allocate(size_t size);
+  char* NewChunk(size_t size);
+  void AddPiece(StringView piece);
+};
+
+template <typename Allocator, typename GrowthPolicy>
+StringBuilder& StringBuilder::Append(
+    const BasicString<Allocator, GrowthPolicy>& string) {
+  return AppendView(string);
+}
+
+template <typename Allocator, typename GrowthPolicy>
+StringBuilder& StringBuilder::Append(
+    BasicString<Allocator, GrowthPolicy>&& string) {
+  return Append(StringView(string));
+}
+
+// Elements the range yields by value are temporaries and get copied.
+template <typename Range>
+StringBuilder& StringBuilder::Join(const Range& range, StringView delim) {
+  bool first = true;
+  for (auto&& element : range) {
+    if (!first) {
+      Append(delim);
+    }
+    first = false;
+    Append(std::forward<decltype(element)>(element));
+  }
+
+  return *this;
+}
+
+template <typename Callback>
+void StringBuilder::ForEachPiece(Callback callback) const {
+  for (StringView piece : pieces_) {
+    callback(piece);
+  }
+}
+
+template <typename Allocator>
+BasicString<Allocator> StringBuilder::Build(const Allocator& alloc) const {
+  BasicString<Allocator> built(alloc);
+  built.Reserve(size_);
+  for (StringView piece : pieces_) {
+    built.Append(piece);
+  }
+
+  return built;
+}
+
+class StringPool;
+
+// Handle to a string stored once in a StringPool; it stays valid for the
+// pool's lifetime. Handles from one pool are equal exactly when their
+// pointers are, handles from different pools should not be compared.
+class InternedString {
+ public:
+  InternedString() = default;
+
+  bool Empty() const;
+  size_t Size() const;
+  // Null-terminated.
+  const char* Data() const;
+  // Hash of the characters, computed once when interned.
+  uint64_t Hash() const;
+
+  operator StringView() const;
+
+  friend bool operator==(InternedString lhs, InternedString rhs) {
+    return lhs.entry_ == rhs.entry_;
+  }
+  friend std::ostream& operator<<(std::ostream& ostream,
+                                  InternedString string) {
+    return ostream << StringView(string);
+  }
+
+ private:
+  friend class StringPool;
+
+  // The characters and a terminator follow it in the same allocation.
+  struct Entry {
+    uint64_t hash;
+    size_t size;
+  };
+
+  const Entry* entry_ = nullptr;
+
+  explicit InternedString(const Entry* entry);
+};
+
+template <>
+struct std::hash<InternedString> {
+  size_t operator()(InternedString string) const { return string.Hash(); }
+};
+
+// Interns strings into an open-addressed table with linear probing, kept at
+// most half full. Each slot keeps the full hash next to the entry pointer,
+// so probing touches only the slot array until the hashes match.
+//
+// Lookups take no lock: a slot's entry is published by a release store of
+// its hash. Inserts take a mutex; growing fills a new table, publishes it
+// and keeps the old ones alive until the pool dies, since readers may still
+// probe them. A stale table only ever misses, and Intern then retries under
+// the lock.
+class StringPool {
+ public:
+  StringPool();
+  StringPool(const StringPool& other) = delete;
+  StringPool& operator=(const StringPool& other) = delete;
+  ~StringPool();
+
+  // The empty string is always the default InternedString.
+  InternedString Intern(StringView text);
+  // False, leaving `interned` alone, if `text` has not been interned.
+  bool Find(StringView text, InternedString* interned) const;
+  size_t Size() const;
+
+ private:
+  using Entry = InternedString::Entry;
+
+  // A zero hash marks an empty slot, so real zero hashes are stored as 1.
+  struct Slot {
+    std::atomic<uint64_t> hash;
+    std::atomic<const Entry*> entry;
+  };
+
+  struct Table {
+    size_t mask;
+    std::unique_ptr<Slot[]> slots;
+  };
+
+  static constexpr size_t kInitialSlots = 64;
+
+  std::vector<std::unique_ptr<Table>> tables_;
+  std::atomic<const Table*> current_;
+  std::atomic<size_t> size_ = 0;
+  std::mutex mutex_;
+
+  static uint64_t SlotHash(StringView text);
+  static const Entry* NewEntry(StringView text, uint64_t hash);
+  static const Entry* Lookup(const Table& table, StringView text,
+                             uint64_t hash);
+  static void Insert(const Table& table, const Entry* entry);
+  const Table& AddTable(size_t slots);
+  const Table& Grow();
+};
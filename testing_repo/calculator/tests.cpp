@@ -127,6 +127,20 @@ TEST(ExceptionsInt, Exeption2) {
   ASSERT_THROW(Calculator<int>::CalculateExpr(expr), std::exception);
 }
 
+TEST(Operand, Formatting) {
+  EXPECT_EQ(OperandToken<double>(1.0 / 3).GetStringToken(), "0.333333");
+  EXPECT_EQ(OperandToken<double>(1e20).GetStringToken(), "1e+20");
+  EXPECT_EQ(OperandToken<int>(-42).GetStringToken(), "-42");
+  EXPECT_EQ(OperandToken<bool>(true).GetStringToken(), "1");
+}
+
+TEST(Operand, Parsing) {
+  EXPECT_EQ(OperandToken<int>("+7").GetValue(), 7);
+  EXPECT_EQ(OperandToken<double>(" 2.5").GetValue(), 2.5);
+  EXPECT_EQ(OperandToken<int>("x").GetValue(), 0);
+  EXPECT_TRUE(OperandToken<bool>("1").GetValue());
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
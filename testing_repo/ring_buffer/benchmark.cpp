@@ -0,0 +1,274 @@
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../deque/deque.hpp"
+#include "benchmark_utils.hpp"
+#include "ring_buffer.hpp"
+
+class MutexRingBuffer {
+ public:
+  explicit MutexRingBuffer(size_t capacity) : buffer_(capacity) {}
+
+  bool TryPush(uint64_t element) {
+    std::lock_guard lock(mutex_);
+    return buffer_.TryPush(element);
+  }
+
+  bool TryPop(uint64_t* element) {
+    std::lock_guard lock(mutex_);
+    return buffer_.TryPop(element);
+  }
+
+ private:
+  std::mutex mutex_;
+  RingBuffer<uint64_t> buffer_;
+};
+
+template <size_t Size>
+struct Record {
+  char bytes[Size];
+};
+
+static constexpr size_t kCapacity = 1024;
+static constexpr size_t kBatch = 32;
+static constexpr int kElements = 1000000;
+static constexpr int kRoundTrips = 100000;
+static constexpr size_t kMaxThreads = 32;
+static constexpr size_t kBurst = 4096;
+
+template <typename Body>
+double OpsPerSecond(double ops, Body body) {
+  auto start = std::chrono::steady_clock::now();
+  body();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  return ops / elapsed.count();
+}
+
+// Busy-waits for a short while and then yields, so that ping-pong works on
+// machines with fewer cores than threads.
+template <typename Queue>
+void SpinPop(Queue& queue, uint64_t* element) {
+  for (int spin = 0; !queue.TryPop(element); ++spin) {
+    if (spin > internal::kSpinIterations) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+template <typename Queue>
+void SpinPush(Queue& queue, uint64_t element) {
+  for (int spin = 0; !queue.TryPush(element); ++spin) {
+    if (spin > internal::kSpinIterations) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+template <typename Queue>
+double MeasureSingleThread() {
+  Queue queue(kCapacity);
+  uint64_t element = 0;
+
+  return OpsPerSecond(kElements, [&] {
+    for (int i = 0; i < kElements; ++i) {
+      queue.TryPush(i);
+      queue.TryPop(&element);
+    }
+  });
+}
+
+template <typename T>
+double MeasureBatches(size_t batch) {
+  RingBuffer<T, PowerOfTwoCapacity> queue(kCapacity);
+  std::vector<T> in(batch);
+  std::vector<T> out(batch);
+
+  return OpsPerSecond(kElements, [&] {
+    for (int i = 0; i < kElements; i += static_cast<int>(batch)) {
+      if (batch == 1) {
+        queue.TryPush(in[0]);
+        queue.TryPop(&out[0]);
+      } else {
+        queue.TryPushN(in);
+        queue.TryPopN(out);
+      }
+    }
+  });
+}
+
+template <size_t Size>
+void RunBatchSize() {
+  std::string name = "RingBuffer<Record<" + std::to_string(Size) + ">>";
+  ReportThroughput(name + ", one by one", MeasureBatches<Record<Size>>(1));
+  ReportThroughput(name + ", batches of " + std::to_string(kBatch),
+                   MeasureBatches<Record<Size>>(kBatch));
+}
+
+// One thread sends a timestamp, the other echoes it back through a second
+// queue; the histogram holds full round trips. Both sides get their own
+// pinned threads, so the main thread's affinity, which later threads
+// inherit, is left alone.
+template <typename Queue>
+LatencyHistogram MeasurePingPong() {
+  Queue ping(kCapacity);
+  Queue pong(kCapacity);
+  LatencyHistogram histogram;
+
+  std::thread echo([&ping, &pong] {
+    PinToCpu(1);
+    uint64_t stamp = 0;
+    for (int i = 0; i < kRoundTrips; ++i) {
+      SpinPop(ping, &stamp);
+      SpinPush(pong, stamp);
+    }
+  });
+  std::thread send([&ping, &pong, &histogram] {
+    PinToCpu(0);
+    uint64_t stamp = 0;
+    for (int i = 0; i < kRoundTrips; ++i) {
+      SpinPush(ping, NowNanoseconds());
+      SpinPop(pong, &stamp);
+      histogram.Record(NowNanoseconds() - stamp);
+    }
+  });
+  send.join();
+  echo.join();
+
+  return histogram;
+}
+
+template <typename Queue>
+double MeasureThreads(size_t pairs) {
+  Queue queue(kCapacity);
+  int per_thread = kElements / static_cast<int>(pairs);
+  std::vector<std::thread> threads;
+
+  return OpsPerSecond(per_thread * static_cast<double>(pairs), [&] {
+    for (size_t i = 0; i < pairs; ++i) {
+      threads.emplace_back([&queue, per_thread] {
+        for (int i = 0; i < per_thread; ++i) {
+          SpinPush(queue, i);
+        }
+      });
+      threads.emplace_back([&queue, per_thread] {
+        uint64_t element = 0;
+        for (int i = 0; i < per_thread; ++i) {
+          SpinPop(queue, &element);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  });
+}
+
+// Bursts of kBurst pushes followed by as many pops, so the FIFO keeps
+// growing to the burst size and draining again.
+double MeasureGrowable(ShrinkPolicy shrink) {
+  GrowableRingBuffer<int> queue(1, shrink);
+  int element = 0;
+
+  return OpsPerSecond(kElements, [&] {
+    for (int i = 0; i < kElements; i += static_cast<int>(kBurst)) {
+      for (size_t j = 0; j < kBurst; ++j) {
+        queue.Push(i);
+      }
+      while (queue.TryPop(&element)) {
+      }
+    }
+  });
+}
+
+double MeasureDeque() {
+  Deque<int> queue;
+
+  return OpsPerSecond(kElements, [&] {
+    for (int i = 0; i < kElements; i += static_cast<int>(kBurst)) {
+      for (size_t j = 0; j < kBurst; ++j) {
+        queue.push_back(i);
+      }
+      while (!queue.empty()) {
+        queue.pop_front();
+      }
+    }
+  });
+}
+
+void RunThroughput() {
+  ReportThroughput("RingBuffer<ExactCapacity>",
+                   MeasureSingleThread<RingBuffer<uint64_t, ExactCapacity>>());
+  ReportThroughput(
+      "RingBuffer<PowerOfTwoCapacity>",
+      MeasureSingleThread<RingBuffer<uint64_t, PowerOfTwoCapacity>>());
+  ReportThroughput("SpscRingBuffer, same thread",
+                   MeasureSingleThread<SpscRingBuffer<uint64_t>>());
+  ReportThroughput("BlockingSpscRingBuffer, same thread",
+                   MeasureSingleThread<BlockingSpscRingBuffer<uint64_t>>());
+  ReportThroughput("MpmcRingBuffer, same thread",
+                   MeasureSingleThread<MpmcRingBuffer<uint64_t>>());
+  ReportThroughput("BlockingMpmcRingBuffer, same thread",
+                   MeasureSingleThread<BlockingMpmcRingBuffer<uint64_t>>());
+  ReportThroughput("mutex RingBuffer, same thread",
+                   MeasureSingleThread<MutexRingBuffer>());
+}
+
+void RunBatch() {
+  RunBatchSize<8>();
+  RunBatchSize<64>();
+  RunBatchSize<256>();
+}
+
+void RunLatency() {
+  MeasurePingPong<SpscRingBuffer<uint64_t>>().Print("SpscRingBuffer ping-pong");
+  MeasurePingPong<MpmcRingBuffer<uint64_t>>().Print("MpmcRingBuffer ping-pong");
+  MeasurePingPong<MutexRingBuffer>().Print("mutex RingBuffer ping-pong");
+}
+
+void RunScaling() {
+  ReportThroughput("SpscRingBuffer, 2 threads",
+                   MeasureThreads<SpscRingBuffer<uint64_t>>(1));
+  for (size_t threads = 2; threads <= kMaxThreads; threads *= 2) {
+    std::string suffix = ", " + std::to_string(threads) + " threads";
+    ReportThroughput("mutex RingBuffer" + suffix,
+                     MeasureThreads<MutexRingBuffer>(threads / 2));
+    ReportThroughput("MpmcRingBuffer" + suffix,
+                     MeasureThreads<MpmcRingBuffer<uint64_t>>(threads / 2));
+  }
+}
+
+void RunGrowable() {
+  ReportThroughput("GrowableRingBuffer, bursts",
+                   MeasureGrowable(ShrinkPolicy::kNever));
+  ReportThroughput("GrowableRingBuffer with shrinking, bursts",
+                   MeasureGrowable(ShrinkPolicy::kHysteresis));
+  ReportThroughput("Deque, bursts", MeasureDeque());
+}
+
+// Usage: benchmark [throughput|batch|latency|scaling|growable]...
+// Without arguments every group runs.
+int main(int argc, char** argv) {
+  const std::pair<std::string_view, void (*)()> groups[] = {
+      {"throughput", RunThroughput}, {"batch", RunBatch},
+      {"latency", RunLatency},       {"scaling", RunScaling},
+      {"growable", RunGrowable},
+  };
+
+  for (const auto& [name, run] : groups) {
+    bool selected = argc == 1;
+    for (int i = 1; i < argc; ++i) {
+      selected = selected || name == argv[i];
+    }
+    if (selected) {
+      std::cout << "== " << name << " ==" << std::endl;
+      run();
+    }
+  }
+}
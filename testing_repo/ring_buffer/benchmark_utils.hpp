@@ -0,0 +1,99 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+inline constexpr int kNameWidth = 44;
+
+// Log-linear latency histogram: every power of two is split into
+// kSubBuckets linear buckets, so a percentile is exact to within 1/8 of
+// its magnitude while recording stays a couple of bit operations.
+class LatencyHistogram {
+ public:
+  static constexpr size_t kSubBucketBits = 3;
+  static constexpr size_t kSubBuckets = size_t{1} << kSubBucketBits;
+  static constexpr size_t kBuckets = 64 * kSubBuckets;
+
+  void Record(uint64_t nanoseconds) {
+    ++counts_[BucketOf(nanoseconds)];
+    ++total_;
+  }
+
+  uint64_t Percentile(double fraction) const {
+    auto rank = static_cast<uint64_t>(fraction * static_cast<double>(total_));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < kBuckets; ++bucket) {
+      seen += counts_[bucket];
+      if (seen > rank) {
+        return UpperBoundOf(bucket);
+      }
+    }
+    return 0;
+  }
+
+  void Print(std::string_view name) const {
+    std::cout << std::left << std::setw(kNameWidth) << name << " p50 " << std::setw(8)
+              << Percentile(0.5) << " p99 " << std::setw(8) << Percentile(0.99)
+              << " p999 " << std::setw(8) << Percentile(0.999) << " ns"
+              << std::endl;
+    for (size_t bucket = 0; bucket < kBuckets; ++bucket) {
+      if (counts_[bucket] * 1000 >= total_ && total_ != 0) {
+        std::cout << "    <= " << std::setw(10) << UpperBoundOf(bucket) << " ns "
+                  << std::string(counts_[bucket] * 50 / total_ + 1, '#')
+                  << std::endl;
+      }
+    }
+  }
+
+ private:
+  std::array<uint64_t, kBuckets> counts_{};
+  uint64_t total_ = 0;
+
+  static size_t BucketOf(uint64_t value) {
+    if (value < kSubBuckets) {
+      return value;
+    }
+    size_t shift = std::bit_width(value) - 1 - kSubBucketBits;
+    return (shift + 1) * kSubBuckets + ((value >> shift) - kSubBuckets);
+  }
+
+  static uint64_t UpperBoundOf(size_t bucket) {
+    if (bucket < kSubBuckets) {
+      return bucket;
+    }
+    size_t shift = bucket / kSubBuckets - 1;
+    uint64_t mantissa = kSubBuckets + bucket % kSubBuckets;
+    return ((mantissa + 1) << shift) - 1;
+  }
+};
+
+inline uint64_t NowNanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Pins the calling thread; on machines with fewer cores the index wraps.
+inline void PinToCpu(size_t cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu % std::max(std::thread::hardware_concurrency(), 1u), &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+inline void ReportThroughput(std::string_view name, double ops_per_second) {
+  std::cout << std::left << std::setw(kNameWidth) << name << std::fixed
+            << std::setprecision(2) << ops_per_second / 1e6 << " Mops/s"
+            << std::endl;
+}
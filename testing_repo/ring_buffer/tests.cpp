@@ -1,7 +1,15 @@
 #include "ring_buffer.hpp"
 #include <gtest/gtest.h>
 
+#include <chrono>
+#include <cstring>
+#include <memory>
 #include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 
 TEST(Correctness, Empty) {
@@ -54,6 +62,542 @@ TEST(Stress, Random) {
   }
 }
 
+TEST(Correctness, PowerOfTwoCapacity) {
+  RingBuffer<int, PowerOfTwoCapacity> buffer(5);
+  EXPECT_TRUE(8u == buffer.Capacity());
+
+  int i;
+  for (int round = 0; round < 3; ++round) {
+    for (int j = 0; j < 8; ++j) {
+      EXPECT_TRUE(buffer.TryPush(round * 8 + j));
+    }
+    EXPECT_TRUE(!buffer.TryPush(0));
+    EXPECT_TRUE(8u == buffer.Size());
+    for (int j = 0; j < 8; ++j) {
+      EXPECT_TRUE(buffer.TryPop(&i));
+      EXPECT_TRUE(round * 8 + j == i);
+    }
+    EXPECT_TRUE(buffer.Empty());
+  }
+}
+
+TEST(Correctness, ZeroCapacity) {
+  RingBuffer buffer(0);
+
+  int i;
+  EXPECT_TRUE(!buffer.TryPush(0));
+  EXPECT_TRUE(!buffer.TryPop(&i));
+}
+
+TEST(Correctness, MoveOnly) {
+  RingBuffer<std::unique_ptr<int>> buffer(2);
+
+  EXPECT_TRUE(buffer.TryPush(std::make_unique<int>(1)));
+  EXPECT_TRUE(buffer.TryPush(std::make_unique<int>(2)));
+  EXPECT_TRUE(!buffer.TryPush(std::make_unique<int>(3)));
+
+  std::unique_ptr<int> element;
+  EXPECT_TRUE(buffer.TryPop(&element));
+  EXPECT_EQ(1, *element);
+  EXPECT_TRUE(buffer.TryPop(&element));
+  EXPECT_EQ(2, *element);
+}
+
+TEST(Correctness, BatchAcrossWrap) {
+  RingBuffer<std::string> buffer(5);
+  std::vector<std::string> in{"a", "b", "c", "d", "e", "f"};
+  std::vector<std::string> out(10);
+
+  EXPECT_EQ(3u, buffer.TryPushN(std::span(in).first(3)));
+  EXPECT_EQ(2u, buffer.TryPopN(std::span(out).first(2)));
+  EXPECT_EQ(4u, buffer.TryPushN(std::span(in).subspan(2)));
+  EXPECT_EQ(0u, buffer.TryPushN(in));
+
+  EXPECT_EQ(5u, buffer.TryPopN(out));
+  std::vector<std::string> expected{"c", "c", "d", "e", "f"};
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(expected[i], out[i]);
+  }
+  EXPECT_TRUE(buffer.Empty());
+}
+
+TEST(Correctness, ReserveAndPeek) {
+  RingBuffer<char> buffer(4);
+
+  RingSegments<char> slots = buffer.Reserve(3);
+  EXPECT_EQ(3u, slots.Size());
+  std::memcpy(slots.first.data(), "abc", 3);
+  EXPECT_TRUE(buffer.Empty());
+  buffer.Commit(3);
+  EXPECT_EQ(3u, buffer.Size());
+
+  RingSegments<char> ready = buffer.Peek();
+  EXPECT_EQ(3u, ready.first.size());
+  EXPECT_EQ('a', ready.first[0]);
+  buffer.Release(2);
+
+  slots = buffer.Reserve(10);
+  EXPECT_EQ(1u, slots.first.size());
+  EXPECT_EQ(2u, slots.second.size());
+  slots.first[0] = 'd';
+  slots.second[0] = 'e';
+  buffer.Commit(2);
+
+  ready = buffer.Peek();
+  EXPECT_EQ(2u, ready.first.size());
+  EXPECT_EQ(1u, ready.second.size());
+  EXPECT_EQ('c', ready.first[0]);
+  EXPECT_EQ('d', ready.first[1]);
+  EXPECT_EQ('e', ready.second[0]);
+  buffer.Release(ready.Size());
+  EXPECT_TRUE(buffer.Empty());
+}
+
+TEST(Correctness, MirroredStorage) {
+  RingBuffer<int, ExactCapacity, MirroredStorage> buffer(10);
+  const size_t capacity = buffer.Capacity();
+  EXPECT_GE(capacity, 10u);
+  EXPECT_EQ(0u, capacity * sizeof(int) % sysconf(_SC_PAGESIZE));
+
+  std::vector<int> values(capacity);
+  for (size_t i = 0; i < capacity; ++i) {
+    values[i] = static_cast<int>(i);
+  }
+  EXPECT_EQ(capacity, buffer.TryPushN(values));
+  EXPECT_EQ(capacity - 3, buffer.TryPopN(std::span(values).first(capacity - 3)));
+  EXPECT_EQ(5u, buffer.TryPushN(std::span(values).first(5)));
+
+  RingSegments<int> ready = buffer.Peek();
+  EXPECT_EQ(8u, ready.first.size());
+  EXPECT_TRUE(ready.second.empty());
+  std::vector<int> expected{static_cast<int>(capacity) - 3,
+                            static_cast<int>(capacity) - 2,
+                            static_cast<int>(capacity) - 1,
+                            0,
+                            1,
+                            2,
+                            3,
+                            4};
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(expected[i], ready.first[i]);
+  }
+
+  RingSegments<int> slots = buffer.Reserve(capacity);
+  EXPECT_EQ(capacity - 8, slots.first.size());
+  EXPECT_TRUE(slots.second.empty());
+}
+
+struct TwoPages {
+  char bytes[2 * 4096];
+};
+
+TEST(Correctness, MirroredStorageLargeElements) {
+  RingBuffer<TwoPages, ExactCapacity, MirroredStorage> buffer(3);
+  const size_t capacity = buffer.Capacity();
+  EXPECT_GE(capacity, 3u);
+  EXPECT_EQ(0u, capacity * sizeof(TwoPages) % sysconf(_SC_PAGESIZE));
+
+  TwoPages element{};
+  for (size_t i = 0; i < capacity; ++i) {
+    element.bytes[0] = static_cast<char>(i);
+    element.bytes[sizeof(element.bytes) - 1] = static_cast<char>(i);
+    EXPECT_TRUE(buffer.TryPush(element));
+  }
+  EXPECT_TRUE(buffer.TryPop(&element));
+  element.bytes[0] = 'x';
+  element.bytes[sizeof(element.bytes) - 1] = 'y';
+  EXPECT_TRUE(buffer.TryPush(element));
+
+  RingSegments<TwoPages> ready = buffer.Peek();
+  EXPECT_EQ(capacity, ready.first.size());
+  EXPECT_TRUE(ready.second.empty());
+  EXPECT_EQ(1, ready.first[0].bytes[0]);
+  EXPECT_EQ('x', ready.first[capacity - 1].bytes[0]);
+  EXPECT_EQ('y', ready.first[capacity - 1].bytes[sizeof(element.bytes) - 1]);
+}
+
+TEST(Spsc, ReserveAndPeek) {
+  const int count = 100000;
+  SpscRingBuffer<int> buffer(10);
+
+  std::thread producer([&buffer] {
+    for (int i = 0; i < count;) {
+      RingSegments<int> slots = buffer.Reserve(count - i);
+      if (slots.Size() == 0) {
+        std::this_thread::yield();
+      }
+      for (int& slot : slots.first) {
+        slot = i++;
+      }
+      for (int& slot : slots.second) {
+        slot = i++;
+      }
+      buffer.Commit(slots.Size());
+    }
+  });
+
+  for (int expected = 0; expected < count;) {
+    RingSegments<int> ready = buffer.Peek();
+    if (ready.Size() == 0) {
+      std::this_thread::yield();
+    }
+    for (int element : ready.first) {
+      ASSERT_EQ(expected++, element);
+    }
+    for (int element : ready.second) {
+      ASSERT_EQ(expected++, element);
+    }
+    buffer.Release(ready.Size());
+  }
+  producer.join();
+}
+
+TEST(Spsc, Batches) {
+  const int count = 100000;
+  SpscRingBuffer<int, PowerOfTwoCapacity> buffer(64);
+
+  std::thread producer([&buffer] {
+    std::vector<int> batch(7);
+    for (int i = 0; i < count;) {
+      size_t size = std::min<size_t>(batch.size(), count - i);
+      for (size_t j = 0; j < size; ++j) {
+        batch[j] = i + static_cast<int>(j);
+      }
+      size_t pushed = buffer.TryPushN(std::span(batch).first(size));
+      if (pushed == 0) {
+        std::this_thread::yield();
+      }
+      i += static_cast<int>(pushed);
+    }
+  });
+
+  std::vector<int> batch(5);
+  for (int expected = 0; expected < count;) {
+    size_t size = buffer.TryPopN(batch);
+    if (size == 0) {
+      std::this_thread::yield();
+    }
+    for (size_t j = 0; j < size; ++j) {
+      ASSERT_EQ(expected++, batch[j]);
+    }
+  }
+  producer.join();
+}
+
+TEST(Growable, GrowsAcrossWrap) {
+  GrowableRingBuffer<std::string> buffer(2);
+
+  std::string element;
+  buffer.Push("0");
+  buffer.Push("1");
+  EXPECT_TRUE(buffer.TryPop(&element));
+  for (int i = 2; i < 100; ++i) {
+    buffer.Push(std::to_string(i));
+  }
+  EXPECT_EQ(99u, buffer.Size());
+  EXPECT_GE(buffer.Capacity(), 99u);
+
+  for (int i = 1; i < 100; ++i) {
+    EXPECT_TRUE(buffer.TryPop(&element));
+    EXPECT_EQ(std::to_string(i), element);
+  }
+  EXPECT_TRUE(!buffer.TryPop(&element));
+}
+
+TEST(Growable, ShrinksAfterBurst) {
+  GrowableRingBuffer<int, PowerOfTwoCapacity> buffer(
+      4, ShrinkPolicy::kHysteresis);
+
+  for (int i = 0; i < 1000; ++i) {
+    buffer.Push(i);
+  }
+  EXPECT_EQ(1024u, buffer.Capacity());
+
+  int element;
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(buffer.TryPop(&element));
+    EXPECT_EQ(i, element);
+  }
+  EXPECT_EQ(4u, buffer.Capacity());
+
+  GrowableRingBuffer<int> keeper(4);
+  for (int i = 0; i < 100; ++i) {
+    keeper.Push(i);
+  }
+  while (keeper.TryPop(&element)) {
+  }
+  EXPECT_EQ(128u, keeper.Capacity());
+}
+
+TEST(Spsc, PushAndPop) {
+  SpscRingBuffer buffer(2);
+
+  int i;
+  EXPECT_TRUE(buffer.TryPush(0));
+  EXPECT_TRUE(buffer.TryPush(1));
+  EXPECT_TRUE(!buffer.TryPush(2));
+  EXPECT_TRUE(2u == buffer.Size());
+
+  EXPECT_TRUE(buffer.TryPop(&i));
+  EXPECT_TRUE(0 == i);
+  EXPECT_TRUE(buffer.TryPush(2));
+  EXPECT_TRUE(buffer.TryPop(&i));
+  EXPECT_TRUE(1 == i);
+  EXPECT_TRUE(buffer.TryPop(&i));
+  EXPECT_TRUE(2 == i);
+
+  EXPECT_TRUE(!buffer.TryPop(&i));
+  EXPECT_TRUE(buffer.Empty());
+}
+
+TEST(Spsc, ZeroCapacity) {
+  SpscRingBuffer buffer(0);
+
+  int i;
+  EXPECT_TRUE(!buffer.TryPush(0));
+  EXPECT_TRUE(!buffer.TryPop(&i));
+}
+
+TEST(Spsc, TwoThreads) {
+  const int count = 200000;
+  SpscRingBuffer buffer(64);
+
+  std::thread producer([&buffer] {
+    for (int i = 0; i < count; ++i) {
+      while (!buffer.TryPush(i)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  int element;
+  for (int expected = 0; expected < count; ++expected) {
+    while (!buffer.TryPop(&element)) {
+      std::this_thread::yield();
+    }
+    ASSERT_EQ(expected, element);
+  }
+  producer.join();
+  EXPECT_TRUE(buffer.Empty());
+}
+
+template <typename Queue>
+concept HasBlockingPush = requires(Queue& queue) { queue.Push(1); };
+
+TEST(Blocking, OptIn) {
+  static_assert(!HasBlockingPush<SpscRingBuffer<int>>);
+  static_assert(!HasBlockingPush<MpmcRingBuffer<int>>);
+  static_assert(HasBlockingPush<BlockingSpscRingBuffer<int>>);
+  static_assert(HasBlockingPush<BlockingMpmcRingBuffer<int>>);
+  static_assert(sizeof(SpscRingBuffer<int>) <
+                sizeof(BlockingSpscRingBuffer<int>));
+}
+
+TEST(Blocking, TimedOut) {
+  BlockingSpscRingBuffer<int> buffer(1);
+  const auto timeout = std::chrono::milliseconds(20);
+
+  int i;
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_TRUE(!buffer.PopFor(&i, timeout));
+  EXPECT_GE(std::chrono::steady_clock::now() - start, timeout);
+
+  EXPECT_TRUE(buffer.PushFor(1, timeout));
+  start = std::chrono::steady_clock::now();
+  EXPECT_TRUE(!buffer.PushFor(2, timeout));
+  EXPECT_GE(std::chrono::steady_clock::now() - start, timeout);
+
+  EXPECT_TRUE(buffer.PopFor(&i, timeout));
+  EXPECT_EQ(1, i);
+}
+
+TEST(Blocking, WakesSleepingConsumer) {
+  BlockingSpscRingBuffer<int> buffer(4);
+
+  std::thread producer([&buffer] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    buffer.Push(42);
+  });
+
+  int i = 0;
+  buffer.Pop(&i);
+  EXPECT_EQ(42, i);
+  producer.join();
+}
+
+TEST(Blocking, ManyThreads) {
+  const int threads = 4;
+  const int per_thread = 20000;
+  BlockingMpmcRingBuffer<int> buffer(3);
+  std::vector<std::thread> workers;
+  std::atomic<long long> sum = 0;
+
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&buffer] {
+      for (int i = 0; i < per_thread; ++i) {
+        buffer.Push(i);
+      }
+    });
+    workers.emplace_back([&buffer, &sum] {
+      int element;
+      for (int i = 0; i < per_thread; ++i) {
+        buffer.Pop(&element);
+        sum += element;
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  EXPECT_EQ(1LL * threads * per_thread * (per_thread - 1) / 2, sum.load());
+  EXPECT_TRUE(buffer.Empty());
+}
+
+TEST(Overwriting, KeepsNewest) {
+  OverwritingRingBuffer<int> buffer(4);
+  std::vector<int> snapshot(8);
+
+  EXPECT_EQ(0u, buffer.Snapshot(snapshot));
+  for (int i = 0; i < 10; ++i) {
+    buffer.Push(i);
+  }
+  EXPECT_EQ(4u, buffer.Size());
+  EXPECT_EQ(6u, buffer.Dropped());
+
+  EXPECT_EQ(4u, buffer.Snapshot(snapshot));
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(6 + i, snapshot[i]);
+  }
+  EXPECT_EQ(2u, buffer.Snapshot(std::span(snapshot).first(2)));
+  EXPECT_EQ(8, snapshot[0]);
+  EXPECT_EQ(9, snapshot[1]);
+}
+
+TEST(Overwriting, DroppedDuringPush) {
+  OverwritingRingBuffer<int> buffer(16);
+  const int num_pushes = 1000000;
+  std::atomic<bool> done = false;
+  std::thread writer([&buffer, &done] {
+    for (int i = 0; i < num_pushes; ++i) {
+      buffer.Push(i);
+    }
+    done.store(true);
+  });
+  size_t bad = 0;
+  while (!done.load()) {
+    size_t dropped = buffer.Dropped();
+    bad += dropped > buffer.Written();
+  }
+  writer.join();
+  EXPECT_EQ(0u, bad);
+  EXPECT_EQ(static_cast<size_t>(num_pushes) - 16, buffer.Dropped());
+}
+
+TEST(Overwriting, ConcurrentReaders) {
+  struct Sample {
+    long long first;
+    long long second;
+    long long third;
+  };
+  const long long count = 200000;
+  OverwritingRingBuffer<Sample> buffer(16);
+  std::atomic<bool> done = false;
+
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 3; ++t) {
+    readers.emplace_back([&buffer, &done] {
+      std::vector<Sample> snapshot(16);
+      while (!done.load()) {
+        size_t size = buffer.Snapshot(snapshot);
+        for (size_t i = 0; i < size; ++i) {
+          ASSERT_EQ(snapshot[i].first, snapshot[i].second);
+          ASSERT_EQ(snapshot[i].first, snapshot[i].third);
+          if (i != 0) {
+            ASSERT_EQ(snapshot[i - 1].first + 1, snapshot[i].first);
+          }
+        }
+      }
+    });
+  }
+
+  for (long long i = 0; i < count; ++i) {
+    buffer.Push({i, i, i});
+  }
+  done.store(true);
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(static_cast<size_t>(count) - 16, buffer.Dropped());
+}
+
+TEST(Mpmc, PushAndPop) {
+  MpmcRingBuffer buffer(2);
+
+  int i;
+  EXPECT_TRUE(buffer.TryPush(0));
+  EXPECT_TRUE(buffer.TryPush(1));
+  EXPECT_TRUE(!buffer.TryPush(2));
+  EXPECT_TRUE(2u == buffer.Size());
+
+  EXPECT_TRUE(buffer.TryPop(&i));
+  EXPECT_TRUE(0 == i);
+  EXPECT_TRUE(buffer.TryPop(&i));
+  EXPECT_TRUE(1 == i);
+  EXPECT_TRUE(!buffer.TryPop(&i));
+  EXPECT_TRUE(buffer.Empty());
+}
+
+TEST(Mpmc, SingleSlot) {
+  MpmcRingBuffer buffer(1);
+
+  int i;
+  for (int round = 0; round < 3; ++round) {
+    EXPECT_TRUE(buffer.TryPush(round));
+    EXPECT_TRUE(!buffer.TryPush(round));
+    EXPECT_TRUE(buffer.TryPop(&i));
+    EXPECT_TRUE(round == i);
+    EXPECT_TRUE(!buffer.TryPop(&i));
+  }
+}
+
+TEST(Mpmc, ManyThreads) {
+  const int threads = 4;
+  const int per_thread = 20000;
+  MpmcRingBuffer<int, PowerOfTwoCapacity> buffer(16);
+  std::vector<std::thread> producers;
+  std::vector<std::thread> consumers;
+  std::vector<std::atomic<int>> seen(threads * per_thread);
+
+  for (int t = 0; t < threads; ++t) {
+    producers.emplace_back([&buffer, t] {
+      for (int i = 0; i < per_thread; ++i) {
+        while (!buffer.TryPush(t * per_thread + i)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+    consumers.emplace_back([&buffer, &seen] {
+      int element;
+      for (int i = 0; i < per_thread; ++i) {
+        while (!buffer.TryPop(&element)) {
+          std::this_thread::yield();
+        }
+        seen[element].fetch_add(1);
+      }
+    });
+  }
+  for (int t = 0; t < threads; ++t) {
+    producers[t].join();
+    consumers[t].join();
+  }
+
+  for (auto& count : seen) {
+    ASSERT_EQ(1, count.load());
+  }
+  EXPECT_TRUE(buffer.Empty());
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
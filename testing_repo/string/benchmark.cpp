@@ -0,0 +1,666 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "string.hpp"
+
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+  ++allocations;
+  if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+
+void operator delete(void* pointer, size_t) noexcept { std::free(pointer); }
+
+void operator delete[](void* pointer, size_t) noexcept { std::free(pointer); }
+
+static volatile size_t sink = 0;
+
+static constexpr int kIterations = 200000;
+static constexpr int kLargeIterations = 2000;
+static constexpr int kNameWidth = 44;
+static constexpr size_t kBytesPerRun = size_t{64} << 20;
+static constexpr size_t kMinBulkSize = 8;
+static constexpr size_t kMaxBulkSize = size_t{1} << 20;
+static constexpr size_t kBulkSizeStep = 8;
+static constexpr int kSortKeys = 1000000;
+static constexpr size_t kArenaSize = size_t{1} << 16;
+static constexpr int kRequestLines = 32;
+static constexpr size_t kConfigSize = size_t{64} << 10;
+static constexpr size_t kConsumers = 16;
+static constexpr size_t kSection = 4096;
+static constexpr size_t kOutputSize = size_t{4} << 20;
+static constexpr size_t kQuadraticSize = size_t{256} << 10;
+static constexpr int kOutputIterations = 50;
+static constexpr int kDistinctKeys = 4096;
+
+// Runs `body` `iterations` times, feeding its results into `sink` so they
+// stay alive, and prints time and heap allocations per iteration.
+template <typename Body>
+void Measure(std::string_view name, Body body, int iterations = kIterations) {
+  size_t allocations_before = allocations;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    sink = sink + body(i);
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::cout << std::left << std::setw(kNameWidth) << name << std::fixed
+            << std::setprecision(1) << std::setw(10)
+            << elapsed.count() / iterations << " ns/iter "
+            << static_cast<double>(allocations - allocations_before) /
+                   iterations
+            << " allocs/iter" << std::endl;
+}
+
+// Runs `body` on `size`-byte strings until kBytesPerRun bytes went through
+// and prints the throughput.
+template <typename Body>
+void MeasureBytes(std::string_view name, size_t size, Body body) {
+  size_t iterations = std::max<size_t>(kBytesPerRun / size, 1);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    sink = sink + body();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::string label = std::string(name) + ", " + std::to_string(size) + " B";
+  std::cout << std::left << std::setw(kNameWidth) << label << std::fixed
+            << std::setprecision(2)
+            << static_cast<double>(iterations * size) / elapsed.count() / 1e9
+            << " GB/s" << std::endl;
+}
+
+template <typename Str>
+Str MakeKey(const Str& name, const Str& value) {
+  return name + Str("=") + value;
+}
+
+// Log-line shaped work on short tokens: split, rebuild key=value pairs,
+// keep them in a vector and hand them around by value.
+template <typename Str>
+size_t ShortTokens(const std::vector<Str>& words) {
+  std::vector<Str> pairs;
+  for (size_t i = 0; i + 1 < words.size(); i += 2) {
+    pairs.push_back(MakeKey(words[i], words[i + 1]));
+  }
+  Str last = std::move(pairs.back());
+  Str copy = last;
+
+  return pairs.size() + (copy == last);
+}
+
+void RunAllocations() {
+  const char* line = "ts 1700000000 lvl info host web-17 path /api/v1/users";
+  const String line_string = line;
+  std::vector<String> words = line_string.Split();
+  std::vector<std::string> std_words;
+  for (const auto& word : words) {
+    std_words.emplace_back(word.Data());
+  }
+
+  Measure("String, split line", [&](int) {
+    auto tokens = String(line).Split();
+    return tokens.size();
+  });
+  Measure("String, SplitView line", [&](int) {
+    size_t total = 0;
+    for (StringView token : line_string.SplitView()) {
+      total += token.Size();
+    }
+    return total;
+  });
+  Measure("String, ForEachSplit line", [&](int) {
+    size_t total = 0;
+    line_string.ForEachSplit(
+        " ", [&total](StringView token) { total += token.Size(); });
+    return total;
+  });
+  Measure("String, Join tokens", [&](int) {
+    return String(",").Join(words).Size();
+  });
+  Measure("String, Join SplitView", [&](int) {
+    return String(",").Join(line_string.SplitView()).Size();
+  });
+  Measure("String, short key=value tokens",
+          [&](int) { return ShortTokens(words); });
+  Measure("std::string, short key=value tokens",
+          [&](int) { return ShortTokens(std_words); });
+  Measure("String, move out of operator+", [&](int) {
+    String joined = words[0] + words[1] + words[2] + words[3];
+    return joined.Size();
+  });
+}
+
+void RunBulkCopy() {
+  for (size_t size = kMinBulkSize; size <= kMaxBulkSize;
+       size *= kBulkSizeStep) {
+    String source(size, 'x');
+    String target;
+    std::vector<char> raw(size + 1, 'x');
+    raw.back() = '\0';
+
+    MeasureBytes("String(const char*)", size,
+                 [&] { return String(raw.data()).Size(); });
+    MeasureBytes("String(const String&)", size,
+                 [&] { return String(source).Size(); });
+    MeasureBytes("operator=(const String&)", size, [&] {
+      target = source;
+      return target.Size();
+    });
+    MeasureBytes("Reserve", size, [&] {
+      String grown = source;
+      grown.Reserve(2 * size);
+      return grown.Capacity();
+    });
+    MeasureBytes("ShrinkToFit", size, [&] {
+      String shrunk = source;
+      shrunk.Reserve(2 * size);
+      shrunk.ShrinkToFit();
+      return shrunk.Capacity();
+    });
+    MeasureBytes("Resize(n, character)", size, [&] {
+      String filled;
+      filled.Resize(size, 'y');
+      return filled.Size();
+    });
+  }
+}
+
+void RunAppend() {
+  const String pair = "ab";
+  const std::string std_pair = "ab";
+  const String token = "token";
+  const std::string std_token = "token";
+
+  MeasureBytes("String, \"ab\" * count", kMaxBulkSize,
+               [&] { return (pair * (kMaxBulkSize / 2)).Size(); });
+  MeasureBytes("std::string, += \"ab\" repeatedly", kMaxBulkSize, [&] {
+    std::string repeated;
+    for (size_t i = 0; i < kMaxBulkSize / 2; ++i) {
+      repeated += std_pair;
+    }
+    return repeated.size();
+  });
+  MeasureBytes("String, += short tokens", kMaxBulkSize, [&] {
+    String appended;
+    for (size_t i = 0; i < kMaxBulkSize / token.Size(); ++i) {
+      appended += token;
+    }
+    return appended.Size();
+  });
+  MeasureBytes("std::string, += short tokens", kMaxBulkSize, [&] {
+    std::string appended;
+    for (size_t i = 0; i < kMaxBulkSize / std_token.size(); ++i) {
+      appended += std_token;
+    }
+    return appended.size();
+  });
+}
+
+// Needles that never occur in a 1 MiB log-like haystack, so every search
+// scans all of it; the longer ones are near misses of the repeated line.
+void RunSearch() {
+  const std::string line = "lvl=info host=web-17 path=/api/v1/users ";
+  std::string std_hay;
+  while (std_hay.size() < kMaxBulkSize) {
+    std_hay += line;
+  }
+  const String hay = std_hay.data();
+  const char* needles[] = {"#", "user#", "path=/api/v1/user#",
+                           "lvl=info host=web-17 path=/api/v1/user#"};
+
+  for (const char* needle : needles) {
+    std::string suffix =
+        ", " + std::to_string(std::strlen(needle)) + "-byte needle";
+    MeasureBytes("String" + suffix, hay.Size(),
+                 [&] { return hay.Find(needle); });
+    MeasureBytes("std::string" + suffix, hay.Size(),
+                 [&] { return std_hay.find(needle); });
+  }
+  MeasureBytes("String::Count \"users\"", hay.Size(),
+               [&] { return hay.Count("users"); });
+}
+
+// Per-request monotonic arena: allocation bumps a pointer, deallocation is
+// a no-op and everything is released at once when the request is over.
+class Arena {
+ public:
+  explicit Arena(std::vector<std::byte>& buffer)
+      : current_(buffer.data()), end_(buffer.data() + buffer.size()) {}
+
+  void* Allocate(size_t size, size_t alignment) {
+    auto address = reinterpret_cast<uintptr_t>(current_);
+    auto* aligned = current_ + ((alignment - address % alignment) % alignment);
+    if (aligned + size > end_) {
+      throw std::bad_alloc();
+    }
+    current_ = aligned + size;
+    return aligned;
+  }
+
+ private:
+  std::byte* current_;
+  std::byte* end_;
+};
+
+template <typename T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+
+  explicit ArenaAllocator(Arena* arena) : arena_(arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.GetArena()) {}
+
+  T* allocate(size_t count) {
+    return static_cast<T*>(arena_->Allocate(count * sizeof(T), alignof(T)));
+  }
+  void deallocate(T*, size_t) {}
+
+  Arena* GetArena() const { return arena_; }
+  bool operator==(const ArenaAllocator& other) const {
+    return arena_ == other.arena_;
+  }
+
+ private:
+  Arena* arena_;
+};
+
+using ArenaString = BasicString<ArenaAllocator<char>>;
+
+// A request's worth of short-lived strings: parse fields out of its header
+// lines, keep them as tagged copies and join the result.
+template <typename Str, typename Alloc>
+size_t HandleRequest(const Alloc& alloc) {
+  const char* header =
+      "x-request-id=5f0c2a3e-9b1d-4e2f-8a6b-0d7c9e1f2a3b "
+      "x-forwarded-for=10.0.0.17,10.0.0.18 user-agent=curl/8.4.0-release "
+      "accept-language=en-US,en;q=0.9,de;q=0.8";
+  Str line(header, alloc);
+  std::vector<Str, typename std::allocator_traits<
+                       Alloc>::template rebind_alloc<Str>>
+      pairs(alloc);
+  for (int header_line = 0; header_line < kRequestLines; ++header_line) {
+    for (StringView field : line.SplitView()) {
+      Str pair(StringView("header:"), alloc);
+      pair.Append(field);
+      pairs.push_back(std::move(pair));
+    }
+  }
+  return Str("; ", alloc).Join(pairs).Size();
+}
+
+void RunArena() {
+  Measure("String, request", [](int) {
+    return HandleRequest<String>(std::allocator<char>());
+  });
+  std::vector<std::byte> buffer(kArenaSize);
+  Measure("ArenaString, request", [&buffer](int) {
+    Arena arena(buffer);
+    return HandleRequest<ArenaString>(ArenaAllocator<char>(&arena));
+  });
+}
+
+// A large config handed to a group of consumers, each of which also keeps
+// one of its sections.
+void RunShared() {
+  const String config(kConfigSize, 'c');
+  const SharedString shared(config);
+
+  Measure(
+      "String, copy to consumers",
+      [&](int) {
+        std::vector<String> consumers(kConsumers, config);
+        return consumers.back().Size();
+      },
+      kLargeIterations);
+  Measure(
+      "SharedString, copy to consumers",
+      [&](int) {
+        std::vector<SharedString> consumers(kConsumers, shared);
+        return consumers.back().Size();
+      },
+      kLargeIterations);
+  Measure("String, slice sections", [&](int) {
+    size_t total = 0;
+    for (size_t i = 0; i < kConsumers; ++i) {
+      total += String(StringView(config.Data() + i, kSection)).Size();
+    }
+    return total;
+  });
+  Measure("SharedString, slice sections", [&](int) {
+    size_t total = 0;
+    for (size_t i = 0; i < kConsumers; ++i) {
+      total += shared.Substr(i, kSection).Size();
+    }
+    return total;
+  });
+}
+
+// A multi-megabyte report assembled from short formatted lines. The
+// first pass is not timed: it lets malloc settle on its mmap threshold.
+void RunBuilder() {
+  const String line = "2024-01-01T00:00:00Z web-17 GET /api/v1/users 200\n";
+  auto concat = [&line](size_t size) {
+    String out;
+    for (size_t i = 0; i < size / line.Size(); ++i) {
+      out = out + line;
+    }
+    return out;
+  };
+  auto append = [&line] {
+    String out;
+    for (size_t i = 0; i < kOutputSize / line.Size(); ++i) {
+      out += line;
+    }
+    return out;
+  };
+  auto build = [&line] {
+    StringBuilder builder;
+    for (size_t i = 0; i < kOutputSize / line.Size(); ++i) {
+      builder.Append(line);
+    }
+    return builder;
+  };
+  int null_fd = open("/dev/null", O_WRONLY);
+  sink = sink + append().Size() + build().Build().Size();
+
+  Measure(
+      "String, out = out + line, 256 KiB",
+      [&](int) { return concat(kQuadraticSize).Size(); }, 1);
+  Measure(
+      "String, out += line", [&](int) { return append().Size(); },
+      kOutputIterations);
+  Measure(
+      "StringBuilder, Append + Build",
+      [&](int) { return build().Build().Size(); }, kOutputIterations);
+  Measure(
+      "String, out += line + write",
+      [&](int) {
+        String out = append();
+        return static_cast<size_t>(write(null_fd, out.Data(), out.Size()));
+      },
+      kOutputIterations);
+  Measure(
+      "StringBuilder, Append + WriteTo",
+      [&](int) { return static_cast<size_t>(build().WriteTo(null_fd)); },
+      kOutputIterations);
+  close(null_fd);
+}
+
+// A few thousand same-length keys with a common prefix, looked up and
+// compared in a random order.
+void RunIntern() {
+  std::vector<std::string> std_keys;
+  for (int i = 0; i < kDistinctKeys; ++i) {
+    std_keys.push_back("tenant/eu-west/user:" + std::to_string(1000 + i));
+  }
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<size_t> pick(0, kDistinctKeys - 1);
+  StringPool pool;
+  std::unordered_set<std::string> std_set(std_keys.begin(), std_keys.end());
+  std::vector<std::string> std_stream;
+  std::vector<String> stream;
+  std::vector<InternedString> interned_stream;
+  for (int i = 0; i < kIterations; ++i) {
+    std_stream.push_back(std_keys[pick(gen)]);
+    stream.emplace_back(std_stream.back().data());
+    interned_stream.push_back(pool.Intern(stream.back()));
+  }
+  const String target = std_keys.front().data();
+  const InternedString interned_target = pool.Intern(target);
+
+  Measure("String ==, hot keys",
+          [&](int i) { return static_cast<size_t>(stream[i] == target); });
+  Measure("InternedString ==, hot keys", [&](int i) {
+    return static_cast<size_t>(interned_stream[i] == interned_target);
+  });
+  Measure("StringPool::Intern, hot keys",
+          [&](int i) { return pool.Intern(stream[i]).Size(); });
+  Measure("std::unordered_set<std::string>::find", [&](int i) {
+    return std_set.find(std_stream[i])->size();
+  });
+}
+
+// Builds a 1 MiB string with PushBack and a 1 MiB string from 5-byte
+// appends and reports the time and the string allocation counters.
+template <typename Growth>
+void MeasureGrowth(std::string_view name) {
+  using Str = BasicString<std::allocator<char>, CountingGrowth<Growth>>;
+  const StringView token = "token";
+  ResetStringMemoryStats();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kOutputIterations; ++i) {
+    Str pushed;
+    Str appended;
+    for (size_t j = 0; j < kMaxBulkSize; ++j) {
+      pushed.PushBack('x');
+    }
+    for (size_t j = 0; j < kMaxBulkSize / token.Size(); ++j) {
+      appended.Append(token);
+    }
+    sink = sink + pushed.Size() + appended.Size();
+  }
+  std::chrono::duration<double, std::micro> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  StringMemoryStats stats = GetStringMemoryStats();
+  std::cout << std::left << std::setw(kNameWidth) << name << std::fixed
+            << std::setprecision(1) << elapsed.count() / kOutputIterations
+            << " us/iter " << stats.reallocations / kOutputIterations
+            << " reallocs/iter "
+            << static_cast<double>(stats.allocated_bytes) / kOutputIterations /
+                   kMaxBulkSize
+            << " MiB/iter" << std::endl;
+}
+
+void RunGrowth() {
+  MeasureGrowth<DoublingGrowth>("DoublingGrowth");
+  MeasureGrowth<OneAndHalfGrowth>("OneAndHalfGrowth");
+  MeasureGrowth<SizeClassGrowth>("SizeClassGrowth");
+}
+
+// 1 MiB of ASCII log lines and 1 MiB of mostly two- and three-byte text;
+// the decode loop is the one-code-point-at-a-time baseline.
+void RunUtf8() {
+  const std::pair<std::string_view, String> texts[] = {
+      {"ascii", String("lvl=info host=web-17 path=/api/v1/users ")},
+      {"mixed", String("Привет, мир! 日本語のテキスト Größe 🎉 ")},
+  };
+  for (const auto& [kind, line] : texts) {
+    String text = line * (kMaxBulkSize / line.Size());
+    std::string suffix = ", " + std::string(kind);
+    MeasureBytes("IsValidUtf8" + suffix, text.Size(),
+                 [&] { return static_cast<size_t>(text.IsValidUtf8()); });
+    MeasureBytes("decode loop" + suffix, text.Size(), [&] {
+      size_t total = 0;
+      for (char32_t code_point : text.CodePoints()) {
+        total += code_point;
+      }
+      return total;
+    });
+    MeasureBytes("CodePointCount" + suffix, text.Size(),
+                 [&] { return text.CodePointCount(); });
+    MeasureBytes("FoldCase" + suffix, text.Size(),
+                 [&] { return text.FoldCase().Size(); });
+  }
+}
+
+// The stream path is what OperandToken did: one stream per number.
+template <typename Number>
+void MeasureParsing(std::string_view type, const std::vector<String>& texts) {
+  std::vector<std::string> std_texts;
+  for (const String& text : texts) {
+    std_texts.emplace_back(text.Data(), text.Size());
+  }
+  Measure("String::Parse, " + std::string(type), [&](int i) {
+    Number value = 0;
+    if constexpr (std::is_integral_v<Number>) {
+      texts[i % kDistinctKeys].ParseInt(&value);
+    } else {
+      texts[i % kDistinctKeys].ParseDouble(&value);
+    }
+    return static_cast<size_t>(value);
+  });
+  Measure("std::istringstream >> " + std::string(type), [&](int i) {
+    std::istringstream stream(std_texts[i % kDistinctKeys]);
+    Number value = 0;
+    stream >> value;
+    return static_cast<size_t>(value);
+  });
+}
+
+template <typename Number>
+void MeasureFormatting(std::string_view type,
+                       const std::vector<Number>& numbers) {
+  String out;
+  Measure("String::AppendNumber, " + std::string(type), [&](int i) {
+    out.Clear();
+    return out.AppendNumber(numbers[i % kDistinctKeys]).Size();
+  });
+  Measure("std::ostringstream << " + std::string(type), [&](int i) {
+    std::ostringstream stream;
+    stream.precision(std::numeric_limits<Number>::max_digits10);
+    stream << numbers[i % kDistinctKeys];
+    return stream.str().size();
+  });
+}
+
+void RunNumbers() {
+  std::mt19937_64 gen(1);
+  std::uniform_real_distribution<double> real(-1e6, 1e6);
+  std::vector<int64_t> ints;
+  std::vector<double> doubles;
+  std::vector<String> int_texts;
+  std::vector<String> double_texts;
+  for (int i = 0; i < kDistinctKeys; ++i) {
+    // Shifted so that the lengths vary from 1 to 19 digits.
+    ints.push_back(static_cast<int64_t>(gen()) >> (i % 64));
+    doubles.push_back(real(gen));
+    int_texts.push_back(String().AppendNumber(ints.back()));
+    double_texts.push_back(String().AppendNumber(doubles.back()));
+  }
+  MeasureParsing<int64_t>("int64_t", int_texts);
+  MeasureParsing<double>("double", double_texts);
+  MeasureFormatting("int64_t", ints);
+  MeasureFormatting("double", doubles);
+}
+
+template <typename Str>
+size_t ReadTokens(const std::string& text) {
+  std::istringstream input(text);
+  Str token;
+  size_t total = 0;
+  while (input >> token) {
+    total += token == Str("GET");
+  }
+  return total;
+}
+
+// Whitespace-separated access-log fields read back through operator>>.
+void RunIngest() {
+  const std::string line =
+      "10.0.0.17 GET /api/v1/users?id=1700000000 200 5123 0.004 "
+      "Mozilla/5.0\tcurl/8.4.0\n";
+  std::string text;
+  while (text.size() < kMaxBulkSize) {
+    text += line;
+  }
+
+  MeasureBytes("String, operator>>", text.size(),
+               [&] { return ReadTokens<String>(text); });
+  MeasureBytes("std::string, operator>>", text.size(),
+               [&] { return ReadTokens<std::string>(text); });
+}
+
+template <typename Str>
+std::vector<Str> MakeSortKeys() {
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<int> id(0, kSortKeys);
+  std::vector<Str> keys;
+  for (int i = 0; i < kSortKeys; ++i) {
+    std::string key = "tenant/eu-west/user:" + std::to_string(id(gen));
+    keys.emplace_back(key.data());
+  }
+  return keys;
+}
+
+// Keys share a 20-byte prefix, so each comparison has to get past it.
+template <typename Str>
+void MeasureSort(std::string_view name) {
+  std::vector<Str> keys = MakeSortKeys<Str>();
+  auto start = std::chrono::steady_clock::now();
+  std::sort(keys.begin(), keys.end());
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::cout << std::left << std::setw(kNameWidth) << name << std::fixed
+            << std::setprecision(1) << elapsed.count() << " ms" << std::endl;
+}
+
+void RunSort() {
+  MeasureSort<String>("String, sort 1M keys");
+  MeasureSort<std::string>("std::string, sort 1M keys");
+}
+
+// Usage:
+//   benchmark [allocations|bulk|append|search|sort|ingest|arena|shared|
+//              builder|intern|growth|utf8|numbers]...
+// Without arguments every group runs.
+int main(int argc, char** argv) {
+  const std::pair<std::string_view, void (*)()> groups[] = {
+      {"allocations", RunAllocations},
+      {"bulk", RunBulkCopy},
+      {"append", RunAppend},
+      {"search", RunSearch},
+      {"sort", RunSort},
+      {"ingest", RunIngest},
+      {"arena", RunArena},
+      {"shared", RunShared},
+      {"builder", RunBuilder},
+      {"intern", RunIntern},
+      {"growth", RunGrowth},
+      {"utf8", RunUtf8},
+      {"numbers", RunNumbers},
+  };
+
+  for (const auto& [name, run] : groups) {
+    bool selected = argc == 1;
+    for (int i = 1; i < argc; ++i) {
+      selected = selected || name == argv[i];
+    }
+    if (selected) {
+      std::cout << "== " << name << " ==" << std::endl;
+      run();
+    }
+  }
+}
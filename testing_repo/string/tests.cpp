@@ -1,7 +1,14 @@
 #include "string.hpp"
 #include <gtest/gtest.h>
 
+#include <clocale>
+#include <cstdio>
+#include <limits>
+#include <memory_resource>
 #include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
 
 TEST(Constructors, Default) {
   String s;
@@ -35,6 +42,328 @@ TEST(Constructors, CopyConstructor) {
   ASSERT_NE(s.Data(), s1.Data());
 }
 
+TEST(Constructors, MoveConstructor) {
+  String s(100, 'a');
+  const char* data = s.Data();
+  String t(std::move(s));
+  EXPECT_EQ(t.Data(), data);
+  EXPECT_EQ(t.Size(), 100);
+  EXPECT_TRUE(s.Empty());
+  s.PushBack('b');
+  EXPECT_TRUE(s == "b");
+}
+
+TEST(SmallString, StaysInsideObject) {
+  EXPECT_EQ(sizeof(String), 3 * sizeof(size_t));
+  const String s = "short token";
+  const char* begin = reinterpret_cast<const char*>(&s);
+  EXPECT_TRUE(s.Data() >= begin && s.Data() < begin + sizeof(s));
+  EXPECT_GE(s.Capacity(), 22);
+  EXPECT_EQ(s.Data()[s.Size()], '\0');
+}
+
+TEST(SmallString, GrowsAndShrinksBack) {
+  String s;
+  for (char c = 'a'; c <= 'z'; ++c) {
+    s.PushBack(c);
+  }
+  EXPECT_TRUE(s == "abcdefghijklmnopqrstuvwxyz");
+  s.Resize(5);
+  s.ShrinkToFit();
+  EXPECT_TRUE(s == "abcde");
+  const char* begin = reinterpret_cast<const char*>(&s);
+  EXPECT_TRUE(s.Data() >= begin && s.Data() < begin + sizeof(s));
+}
+
+TEST(Assignment, Move) {
+  String s(100, 'a');
+  String t = "small";
+  const char* data = s.Data();
+  t = std::move(s);
+  EXPECT_EQ(t.Data(), data);
+  EXPECT_EQ(t.Size(), 100);
+
+  String u = "tiny";
+  t = std::move(u);
+  EXPECT_TRUE(t == "tiny");
+}
+
+using PmrString = BasicString<std::pmr::polymorphic_allocator<char>>;
+
+TEST(Allocator, Arena) {
+  char buffer[1024];
+  std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer),
+                                            std::pmr::null_memory_resource());
+  PmrString s(100, 'x', &arena);
+  s += PmrString(" and more", &arena);
+  EXPECT_TRUE(s.Data() >= buffer && s.Data() < buffer + sizeof(buffer));
+  EXPECT_EQ(s.GetAllocator().resource(), &arena);
+
+  std::vector<PmrString> pieces = s.Split(" ");
+  ASSERT_EQ(pieces.size(), 3);
+  EXPECT_EQ(pieces[0].GetAllocator().resource(), &arena);
+  EXPECT_TRUE(pieces[2] == "more");
+}
+
+TEST(Allocator, DoesNotPropagate) {
+  char buffer[1024];
+  std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+  PmrString in_arena(50, 'a', &arena);
+  PmrString on_heap(40, 'b');
+
+  PmrString copy = in_arena;
+  EXPECT_EQ(copy.GetAllocator().resource(), std::pmr::get_default_resource());
+  on_heap = std::move(in_arena);
+  EXPECT_EQ(on_heap.GetAllocator().resource(),
+            std::pmr::get_default_resource());
+  EXPECT_TRUE(on_heap == copy);
+  EXPECT_FALSE(on_heap.Data() >= buffer &&
+               on_heap.Data() < buffer + sizeof(buffer));
+}
+
+TEST(SharedString, CopiesShareBuffer) {
+  String config(1000, 'c');
+  SharedString shared(config);
+  SharedString copy = shared;
+  EXPECT_EQ(copy.Data(), shared.Data());
+  EXPECT_EQ(shared.UseCount(), 2);
+  {
+    SharedString another = copy;
+    EXPECT_EQ(shared.UseCount(), 3);
+  }
+  EXPECT_EQ(shared.UseCount(), 2);
+  EXPECT_TRUE(copy == config);
+  EXPECT_EQ(SharedString().UseCount(), 0);
+}
+
+TEST(SharedString, Substr) {
+  SharedString shared(String("key=value; other=thing"));
+  SharedString value = shared.Substr(4, 5);
+  EXPECT_EQ(value.Data(), shared.Data() + 4);
+  EXPECT_TRUE(value == "value");
+  EXPECT_TRUE(value.Substr(2) == "lue");
+  EXPECT_TRUE(shared.Substr(100).Empty());
+  EXPECT_EQ(shared.UseCount(), 2);
+  shared = SharedString();
+  EXPECT_TRUE(value == "value");
+}
+
+TEST(SharedString, ComparesWithString) {
+  SharedString shared(String("banana"));
+  String apple = "apple";
+  EXPECT_TRUE(shared > apple);
+  EXPECT_TRUE(apple < shared);
+  EXPECT_TRUE(apple != shared);
+  EXPECT_TRUE(String("banana") == shared);
+  EXPECT_TRUE(shared.Substr(1, 3) == shared.Substr(3, 3));
+  EXPECT_TRUE(shared.Substr(0, 1) < shared);
+
+  std::stringstream out;
+  out << shared.Substr(2) << ' ' << shared;
+  EXPECT_EQ(out.str(), "nana banana");
+}
+
+TEST(SharedString, ConcurrentCopies) {
+  SharedString shared(String(100, 'x'));
+  const int num_threads = 4;
+  const int num_iterations = 10000;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([shared] {
+      for (int j = 0; j < num_iterations; ++j) {
+        SharedString copy = shared;
+        SharedString slice = copy.Substr(j % 100);
+        ASSERT_EQ(slice.Size(), 100 - j % 100);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(shared.UseCount(), 1);
+}
+
+TEST(StringBuilder, AppendAndBuild) {
+  std::string expected;
+  StringBuilder builder;
+  for (int i = 0; i < 10000; ++i) {
+    std::string piece = std::to_string(i) + ",";
+    builder.Append(piece.c_str());
+    expected += piece;
+  }
+  String built = builder.Build();
+  EXPECT_EQ(builder.Size(), expected.size());
+  EXPECT_EQ(built.Capacity(), built.Size());
+  EXPECT_EQ(std::string(built.Data()), expected);
+  EXPECT_LT(builder.PieceCount(), 100);
+}
+
+TEST(StringBuilder, SharesWithoutCopying) {
+  String borrowed = "borrowed ";
+  SharedString shared(String(100, 's'));
+  StringBuilder builder;
+  builder.AppendView(borrowed).Append(shared).Append(" copied");
+  EXPECT_EQ(shared.UseCount(), 2);
+
+  std::vector<const char*> pieces;
+  builder.ForEachPiece(
+      [&pieces](StringView piece) { pieces.push_back(piece.Data()); });
+  ASSERT_EQ(pieces.size(), 3);
+  EXPECT_EQ(pieces[0], borrowed.Data());
+  EXPECT_EQ(pieces[1], shared.Data());
+  EXPECT_TRUE(builder.Build() == "borrowed " + String(100, 's') + " copied");
+}
+
+TEST(StringBuilder, RefersToKeptStrings) {
+  const String kept = "kept ";
+  StringBuilder builder;
+  builder.Append(kept).Append(String("temporary"));
+  std::vector<const char*> pieces;
+  builder.ForEachPiece(
+      [&pieces](StringView piece) { pieces.push_back(piece.Data()); });
+  ASSERT_EQ(pieces.size(), 2);
+  EXPECT_EQ(pieces[0], kept.Data());
+  EXPECT_TRUE(builder.Build() == "kept temporary");
+}
+
+TEST(StringBuilder, AppendRepeat) {
+  StringBuilder builder;
+  builder.Append("<").AppendRepeat("ab", 100000).AppendRepeat("", 5);
+  builder.AppendRepeat("c", 3).Append(">");
+  String built = builder.Build();
+  EXPECT_TRUE(built == "<" + String("ab") * 100000 + "ccc>");
+  EXPECT_LT(builder.PieceCount(), 10);
+}
+
+TEST(StringBuilder, JoinAndStream) {
+  std::vector<String> words = {"a", "bb", "ccc"};
+  StringBuilder builder;
+  builder.Join(words, ", ").Append(";");
+  std::stringstream out;
+  out << builder;
+  EXPECT_EQ(out.str(), "a, bb, ccc;");
+  EXPECT_TRUE(StringBuilder().Join(words, "").Build() == "abbccc");
+  EXPECT_TRUE(StringBuilder().Build().Empty());
+}
+
+TEST(StringBuilder, WriteTo) {
+  const String left = "left ";
+  const String right = "right ";
+  StringBuilder builder;
+  for (int i = 0; i < 3000; ++i) {
+    builder.AppendView(i % 2 == 0 ? left : right);
+  }
+  builder.AppendRepeat("xy", 100000).Append("|");
+  StringBuilder moved = std::move(builder);
+  EXPECT_TRUE(builder.Empty());
+  EXPECT_GT(moved.PieceCount(), 3000);
+
+  std::FILE* file = std::tmpfile();
+  ASSERT_NE(file, nullptr);
+  ASSERT_TRUE(moved.WriteTo(fileno(file)));
+  std::rewind(file);
+  std::string read_back;
+  char buffer[4096];
+  for (size_t got; (got = std::fread(buffer, 1, sizeof(buffer), file)) > 0;) {
+    read_back.append(buffer, got);
+  }
+  std::fclose(file);
+  EXPECT_EQ(read_back, std::string(moved.Build().Data()));
+  EXPECT_EQ(read_back.size(), moved.Size());
+}
+
+TEST(StringPool, InternsOnce) {
+  StringPool pool;
+  InternedString first = pool.Intern("user:42");
+  InternedString second = pool.Intern(String("user:") + String("42"));
+  InternedString other = pool.Intern("user:43");
+  EXPECT_TRUE(first == second);
+  EXPECT_EQ(first.Data(), second.Data());
+  EXPECT_FALSE(first == other);
+  EXPECT_STREQ(first.Data(), "user:42");
+  EXPECT_EQ(first.Hash(), second.Hash());
+  EXPECT_EQ(pool.Size(), 2);
+
+  EXPECT_TRUE(pool.Intern("") == InternedString());
+  EXPECT_TRUE(InternedString().Empty());
+  EXPECT_EQ(pool.Size(), 2);
+}
+
+TEST(StringPool, Find) {
+  StringPool pool;
+  InternedString key = pool.Intern("key");
+  InternedString found;
+  EXPECT_FALSE(pool.Find("missing", &found));
+  EXPECT_TRUE(found.Empty());
+  EXPECT_TRUE(pool.Find("key", &found));
+  EXPECT_TRUE(found == key);
+  EXPECT_EQ(pool.Size(), 1);
+}
+
+TEST(StringPool, GrowsAndKeepsHandles) {
+  StringPool pool;
+  std::vector<InternedString> handles;
+  for (int i = 0; i < 10000; ++i) {
+    handles.push_back(pool.Intern(std::to_string(i).c_str()));
+  }
+  EXPECT_EQ(pool.Size(), 10000);
+  for (int i = 0; i < 10000; ++i) {
+    std::string text = std::to_string(i);
+    ASSERT_TRUE(pool.Intern(text.c_str()) == handles[i]);
+    ASSERT_EQ(std::string(handles[i].Data()), text);
+  }
+  std::unordered_set<InternedString> set(handles.begin(), handles.end());
+  EXPECT_EQ(set.size(), 10000);
+}
+
+TEST(StringPool, ConcurrentInterning) {
+  StringPool pool;
+  const int num_threads = 4;
+  const int num_keys = 5000;
+  std::vector<std::vector<InternedString>> seen(num_threads);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&pool, &handles = seen[i], i] {
+      for (int j = 0; j < num_keys; ++j) {
+        int key = (j * (i + 1)) % num_keys;
+        handles.push_back(pool.Intern(std::to_string(key).c_str()));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(pool.Size(), num_keys);
+  for (int i = 0; i < num_threads; ++i) {
+    for (int j = 0; j < num_keys; ++j) {
+      int key = (j * (i + 1)) % num_keys;
+      ASSERT_TRUE(seen[i][j] == pool.Intern(std::to_string(key).c_str()));
+    }
+  }
+}
+
+TEST(StringPool, FindWhileGrowing) {
+  StringPool pool;
+  const int num_keys = 20000;
+  std::atomic<int> interned = 0;
+  std::thread writer([&pool, &interned] {
+    for (int i = 0; i < num_keys; ++i) {
+      pool.Intern(std::to_string(i).c_str());
+      interned.store(i + 1, std::memory_order_release);
+    }
+  });
+  int misses = 0;
+  for (int done = 0; done < num_keys;) {
+    done = interned.load(std::memory_order_acquire);
+    if (done > 0) {
+      InternedString found;
+      misses += !pool.Find(std::to_string(done - 1).c_str(), &found);
+    }
+  }
+  writer.join();
+  EXPECT_EQ(misses, 0);
+}
+
 TEST(Assignment, Simple) {
   const size_t size = 100;
   String s(size, 'a');
@@ -134,6 +463,91 @@ TEST(Reserve, ToBigger) {
   ASSERT_EQ(s.Capacity(), 22);
 }
 
+using CountedString = BasicString<std::allocator<char>, CountingGrowth<>>;
+
+TEST(Reserve, SameCapacityKeepsBuffer) {
+  String s(100, 'a');
+  const char* data = s.Data();
+  s.Reserve(s.Capacity());
+  s.ShrinkToFit();
+  EXPECT_EQ(s.Data(), data);
+  CountedString small = "abc";
+  ResetStringMemoryStats();
+  small.ShrinkToFit();
+  small.Reserve(small.Capacity());
+  EXPECT_EQ(GetStringMemoryStats().reallocations, 0);
+}
+
+template <typename Growth>
+std::vector<size_t> CapacitiesWhilePushing(size_t count) {
+  BasicString<std::allocator<char>, Growth> s;
+  std::vector<size_t> capacities = {s.Capacity()};
+  for (size_t i = 0; i < count; ++i) {
+    s.PushBack('x');
+    if (s.Capacity() != capacities.back()) {
+      capacities.push_back(s.Capacity());
+    }
+  }
+  EXPECT_EQ(s.Size(), count);
+  return capacities;
+}
+
+TEST(Growth, Policies) {
+  auto doubling = CapacitiesWhilePushing<DoublingGrowth>(10000);
+  auto one_and_half = CapacitiesWhilePushing<OneAndHalfGrowth>(10000);
+  auto size_class = CapacitiesWhilePushing<SizeClassGrowth>(10000);
+  EXPECT_EQ(doubling[1], 2 * doubling[0]);
+  EXPECT_EQ(one_and_half[1], one_and_half[0] * 3 / 2);
+  EXPECT_GT(one_and_half.size(), doubling.size());
+  for (size_t i = 1; i < size_class.size(); ++i) {
+    EXPECT_GE(size_class[i], size_class[i - 1] * 3 / 2);
+  }
+  // Capacity plus the terminator lands exactly on a jemalloc size class.
+  const std::vector<size_t> classes = {48,   80,   128,  192,  320,
+                                       512,  768,  1280, 2048, 3072,
+                                       5120, 8192, 12288};
+  EXPECT_EQ(std::vector<size_t>(size_class.begin() + 1, size_class.end()),
+            [&classes] {
+              std::vector<size_t> capacities;
+              for (size_t bytes : classes) {
+                capacities.push_back(bytes - 1);
+              }
+              return capacities;
+            }());
+}
+
+TEST(Growth, SizeClassReserve) {
+  BasicString<std::allocator<char>, SizeClassGrowth> s;
+  s.Reserve(100);
+  EXPECT_EQ(s.Capacity(), 111);
+  s.Reserve(129);
+  EXPECT_EQ(s.Capacity(), 159);
+  s.Resize(10);
+  s.ShrinkToFit();
+  EXPECT_EQ(s.Capacity(), 22);
+}
+
+TEST(MemoryStats, Counts) {
+  ResetStringMemoryStats();
+  size_t live_before = GetStringMemoryStats().live_bytes;
+  {
+    CountedString s(100, 'a');
+    CountedString small = "small";
+    s.Reserve(300);
+    s.Reserve(300);
+    String uncounted(1000, 'a');
+    uncounted.Reserve(2000);
+    StringMemoryStats stats = GetStringMemoryStats();
+    EXPECT_EQ(stats.allocations, 2);
+    EXPECT_EQ(stats.reallocations, 1);
+    EXPECT_EQ(stats.deallocations, 1);
+    EXPECT_EQ(stats.allocated_bytes, 101 + 301);
+    EXPECT_EQ(stats.live_bytes, live_before + 301);
+  }
+  EXPECT_EQ(GetStringMemoryStats().live_bytes, live_before);
+  EXPECT_EQ(GetStringMemoryStats().deallocations, 2);
+}
+
 TEST(ShrinkToFit, ShrinkToFit) {
   String s = "abacabababacabaabacaba";
   s.ShrinkToFit();
@@ -267,6 +681,32 @@ TEST(Comparison, Empty) {
   EXPECT_TRUE(t != s);
 }
 
+TEST(Comparison, DefaultView) {
+  EXPECT_EQ(String().Compare(StringView()), 0);
+  EXPECT_GT(String("a").Compare(StringView()), 0);
+  EXPECT_TRUE(String() == String(StringView()));
+  EXPECT_TRUE(String("a").Append(StringView()) == "a");
+}
+
+TEST(Comparison, Compare) {
+  String s = "abcdef";
+  EXPECT_EQ(s.Compare("abcdef"), 0);
+  EXPECT_LT(s.Compare("abcdeg"), 0);
+  EXPECT_GT(s.Compare("abcde"), 0);
+  EXPECT_LT(s.Compare("abcdefg"), 0);
+  EXPECT_GT(s.Compare(""), 0);
+  EXPECT_EQ(String().Compare(""), 0);
+}
+
+TEST(Comparison, BytesAreUnsigned) {
+  String high = "\xff";
+  String low = "a";
+  EXPECT_TRUE(low < high);
+  EXPECT_TRUE(high >= low);
+  EXPECT_FALSE(high <= low);
+  EXPECT_TRUE(high != low);
+}
+
 TEST(Iostream, In) {
   std::stringstream is{"olololo"};
   String s;
@@ -295,6 +735,31 @@ TEST(Iostream, InWithSpace) {
   ASSERT_EQ(s, String("ab"));
 }
 
+TEST(Iostream, InTokens) {
+  std::string text = "  first\tsecond\n\n" + std::string(5000, 'x') + " \vlast";
+  std::stringstream is{text};
+  std::vector<String> tokens;
+  String s = "stale";
+  while (is >> s) {
+    tokens.push_back(s);
+  }
+  ASSERT_EQ(tokens.size(), 4);
+  EXPECT_TRUE(tokens[0] == "first");
+  EXPECT_TRUE(tokens[1] == "second");
+  EXPECT_TRUE(tokens[2] == String(5000, 'x'));
+  EXPECT_TRUE(tokens[3] == "last");
+  EXPECT_TRUE(is.eof());
+}
+
+TEST(Iostream, InLeavesDelimiter) {
+  std::stringstream is{"ab cd"};
+  String s;
+  is >> s;
+  EXPECT_EQ(is.peek(), ' ');
+  EXPECT_FALSE(is >> s >> s);
+  EXPECT_TRUE(s == "cd");
+}
+
 TEST(Concat, EasyPlus) {
   String s = "aboba";
   String t = "biba";
@@ -348,6 +813,27 @@ TEST(Concat, PlusAssignmentFibonacciStyle) {
   EXPECT_TRUE(s == s_s.data());
 }
 
+TEST(Concat, Self) {
+  String s = "abcdefghij";
+  s += s;
+  s += s;
+  EXPECT_TRUE(s == "abcdefghijabcdefghijabcdefghijabcdefghij");
+}
+
+TEST(Concat, AppendSelfView) {
+  String s(30, 'a');
+  s.Append(StringView(s.Data() + 10, 20));
+  EXPECT_TRUE(s == String(50, 'a'));
+}
+
+TEST(Concat, SingleAllocation) {
+  String s = "aboba";
+  String t(100, 'x');
+  String sum = s + t;
+  EXPECT_EQ(sum.Size(), 105);
+  EXPECT_EQ(sum.Capacity(), 105);
+}
+
 TEST(Multiply, Easy) {
   String s = "aba";
   EXPECT_TRUE(s * 2 == "abaaba");
@@ -363,6 +849,18 @@ TEST(Multiply, Stress) {
   EXPECT_TRUE(s * 1000000 == String(1000000, 'a'));
 }
 
+TEST(Multiply, LongPattern) {
+  String s = "ab";
+  s *= 1000001;
+  ASSERT_EQ(s.Size(), 2000002);
+  EXPECT_EQ(s.Capacity(), 2000002);
+  for (size_t i = 0; i < s.Size(); i += 2) {
+    ASSERT_EQ(s[i], 'a');
+    ASSERT_EQ(s[i + 1], 'b');
+  }
+  EXPECT_EQ(s.Data()[s.Size()], '\0');
+}
+
 TEST(Multiply, Assignment) {
   String s = "a";
   EXPECT_TRUE((s *= 1000000) == String(1000000, 'a'));
@@ -411,6 +909,317 @@ TEST(Split, SomeTests) {
   }
 }
 
+TEST(Split, Overlapping) {
+  std::vector<String> expected{"a", ""};
+  EXPECT_TRUE(expected == String("aab").Split("ab"));
+}
+
+TEST(SplitView, PointsIntoString) {
+  const String s = "  a  b c  def  g h ";
+  std::vector<String> expected{"", "a", "b c", "def", "g h "};
+  std::vector<String> pieces;
+  for (StringView piece : s.SplitView("  ")) {
+    EXPECT_TRUE(piece.Data() >= s.Data() &&
+                piece.Data() + piece.Size() <= s.Data() + s.Size());
+    pieces.emplace_back(piece);
+  }
+  EXPECT_TRUE(expected == pieces);
+}
+
+TEST(SplitView, MatchesSplit) {
+  String s = "hello, world,no split here, , 1, ";
+  std::vector<String> from_views;
+  for (StringView piece : s.SplitView(", ")) {
+    from_views.emplace_back(piece);
+  }
+  EXPECT_TRUE(from_views == s.Split(", "));
+  EXPECT_EQ(std::distance(s.SplitView().begin(), s.SplitView().end()), 7);
+}
+
+TEST(SplitView, Empty) {
+  auto range = String().SplitView();
+  ASSERT_NE(range.begin(), range.end());
+  EXPECT_TRUE((*range.begin()).Empty());
+  EXPECT_EQ(++range.begin(), range.end());
+}
+
+TEST(SplitView, Callback) {
+  String s = "ts=1 lvl=info host=web-17";
+  std::stringstream out;
+  s.ForEachSplit(" ", [&out](StringView piece) { out << piece << ';'; });
+  EXPECT_EQ(out.str(), "ts=1;lvl=info;host=web-17;");
+}
+
+TEST(Find, Easy) {
+  String s = "abracadabra";
+  EXPECT_EQ(s.Find("abra"), 0);
+  EXPECT_EQ(s.Find("abra", 1), 7);
+  EXPECT_EQ(s.Find("c"), 4);
+  EXPECT_EQ(s.Find("abrax"), String::kNpos);
+  EXPECT_EQ(s.Find(""), 0);
+  EXPECT_EQ(s.Find("", 11), 11);
+  EXPECT_EQ(s.Find("", 12), String::kNpos);
+  EXPECT_EQ(s.RFind("abra"), 7);
+  EXPECT_EQ(s.RFind("abra", 6), 0);
+  EXPECT_EQ(s.RFind("z"), String::kNpos);
+  EXPECT_EQ(s.Count("a"), 5);
+  EXPECT_EQ(s.Count("abra"), 2);
+  EXPECT_EQ(String("aaaa").Count("aa"), 2);
+}
+
+TEST(Find, MatchesStd) {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<> letter(0, 2);
+  std::uniform_int_distribution<> needle_size(1, 70);
+  const size_t hay_size = 3000;
+  const size_t num_iterations = 300;
+  std::string hay;
+  for (size_t i = 0; i < hay_size; ++i) {
+    hay.push_back(static_cast<char>('a' + letter(gen) / 2));
+  }
+  hay.replace(hay_size / 2, 100, 100, 'a');
+  String s = hay.data();
+  for (size_t i = 0; i < num_iterations; ++i) {
+    std::string needle = hay.substr(i * 7, needle_size(gen));
+    if (i % 2 == 0) {
+      needle[needle.size() / 2] ^= 1;
+    }
+    size_t from = i % 100;
+    ASSERT_EQ(s.Find(needle.data(), from), hay.find(needle, from)) << needle;
+    ASSERT_EQ(s.RFind(needle.data(), hay_size - from),
+              hay.rfind(needle, hay_size - from))
+        << needle;
+  }
+}
+
+TEST(Utf8, Validates) {
+  EXPECT_TRUE(String("plain ascii").IsValidUtf8());
+  EXPECT_TRUE(String("").IsValidUtf8());
+  EXPECT_TRUE(String("Größe, Привет, 日本語, 🎉").IsValidUtf8());
+  EXPECT_TRUE(String("\xef\xbf\xbd \xf4\x8f\xbf\xbf").IsValidUtf8());
+  const char* invalid[] = {
+      "\x80",          "\xc0\x80",     "\xc1\xbf",      "\xe0\x80\x80",
+      "\xe0\x9f\xbf",  "\xed\xa0\x80", "\xf0\x8f\xbf\xbf",
+      "\xf4\x90\x80\x80", "\xf5\x80\x80\x80", "\xff",  "\xc3",
+      "\xe6\x97",      "\xc3\xa9\xa9", "\xe6\x97\xa5\xa5"};
+  for (const char* bytes : invalid) {
+    for (size_t pad = 0; pad < 40; ++pad) {
+      std::string text = std::string(pad, 'a') + bytes + "z";
+      ASSERT_FALSE(String(text.data()).IsValidUtf8()) << pad << " " << bytes;
+      text.pop_back();
+      ASSERT_FALSE(String(text.data()).IsValidUtf8()) << pad << " " << bytes;
+    }
+  }
+}
+
+bool ReferenceIsValidUtf8(const std::string& text) {
+  for (size_t i = 0; i < text.size();) {
+    auto lead = static_cast<unsigned char>(text[i]);
+    size_t length = lead < 0x80                    ? 1
+                    : lead >= 0xc2 && lead <= 0xdf ? 2
+                    : lead >= 0xe0 && lead <= 0xef ? 3
+                    : lead >= 0xf0 && lead <= 0xf4 ? 4
+                                                   : 0;
+    if (length == 0 || i + length > text.size()) {
+      return false;
+    }
+    unsigned char low = lead == 0xe0 ? 0xa0 : (lead == 0xf0 ? 0x90 : 0x80);
+    unsigned char high = lead == 0xed ? 0x9f : (lead == 0xf4 ? 0x8f : 0xbf);
+    for (size_t k = 1; k < length; ++k) {
+      auto next = static_cast<unsigned char>(text[i + k]);
+      if (next < (k == 1 ? low : 0x80) || next > (k == 1 ? high : 0xbf)) {
+        return false;
+      }
+    }
+    i += length;
+  }
+  return true;
+}
+
+TEST(Utf8, MatchesReference) {
+  const std::string pieces[] = {"a", "é", "Я", "€", "日", "🎉", "\xf4\x8f\xbf\xbf"};
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<> piece(0, std::size(pieces) - 1);
+  std::uniform_int_distribution<> length(0, 80);
+  std::uniform_int_distribution<> byte(0, 255);
+  size_t valid = 0;
+  for (int i = 0; i < 20000; ++i) {
+    std::string text;
+    for (int j = length(gen); j > 0; --j) {
+      text += pieces[piece(gen)];
+    }
+    if (i % 2 == 0 && !text.empty()) {
+      text[byte(gen) % text.size()] = static_cast<char>(byte(gen));
+    }
+    bool expected = ReferenceIsValidUtf8(text);
+    valid += expected ? 1 : 0;
+    ASSERT_EQ(String(StringView(text.data(), text.size())).IsValidUtf8(),
+              expected);
+  }
+  EXPECT_GT(valid, 10000);
+  EXPECT_LT(valid, 20000);
+}
+
+TEST(Utf8, CodePoints) {
+  String text = "aé€🎉";
+  EXPECT_EQ(text.Size(), 10);
+  EXPECT_EQ(text.CodePointCount(), 4);
+  std::vector<char32_t> code_points(text.CodePoints().begin(),
+                                    text.CodePoints().end());
+  EXPECT_EQ(code_points, (std::vector<char32_t>{U'a', U'é', U'€', U'🎉'}));
+
+  String long_text = String("ÿ") * 100;
+  EXPECT_EQ(long_text.CodePointCount(), 100);
+
+  String broken = "a\xc3(\xe2\x82";
+  code_points.assign(broken.CodePoints().begin(), broken.CodePoints().end());
+  EXPECT_EQ(code_points,
+            (std::vector<char32_t>{U'a', 0xfffd, U'(', 0xfffd, 0xfffd}));
+}
+
+TEST(Utf8, FoldCase) {
+  EXPECT_TRUE(String("Hello, WORLD 123").FoldCase() == "hello, world 123");
+  EXPECT_TRUE(String("ÀÉÎÕÜ×ßŸ").FoldCase() == "àéîõü×ßÿ");
+  EXPECT_TRUE(String("ĀăĹĺŁŽſ").FoldCase() == "āăĺĺłžs");
+  EXPECT_TRUE(String("ΑΒΓ ΣΊΣΥΦΟΣ ς").FoldCase() == "αβγ σίσυφοσ σ");
+  EXPECT_TRUE(String("ПРИВЕТ Ёжик ЇЎ").FoldCase() == "привет ёжик їў");
+  EXPECT_TRUE(String("日本 \xff AB").FoldCase() == "日本 \xff ab");
+  String mixed = String("ABCDEFGHIJKLMNOPQRSTUVWXYZ Ä") * 10;
+  String folded = mixed.FoldCase();
+  EXPECT_TRUE(folded == String("abcdefghijklmnopqrstuvwxyz ä") * 10);
+  EXPECT_EQ(folded.CodePointCount(), mixed.CodePointCount());
+}
+
+TEST(Utf8, FoldCaseBlocks) {
+  const std::pair<std::string, std::string> folds[] = {
+      {"\u0345", "\u03b9"}, {"\u0370", "\u0371"}, {"\u0372", "\u0373"},
+      {"\u0376", "\u0377"}, {"\u037f", "\u03f3"}, {"\u0386", "\u03ac"},
+      {"\u0388", "\u03ad"}, {"\u038c", "\u03cc"}, {"\u038f", "\u03ce"},
+      {"\u03aa", "\u03ca"}, {"\u03ab", "\u03cb"}, {"\u03c2", "\u03c3"},
+      {"\u03cf", "\u03d7"}, {"\u03d0", "\u03b2"}, {"\u03d1", "\u03b8"},
+      {"\u03d5", "\u03c6"}, {"\u03d6", "\u03c0"}, {"\u03e2", "\u03e3"},
+      {"\u03f0", "\u03ba"}, {"\u03f1", "\u03c1"}, {"\u03f4", "\u03b8"},
+      {"\u03f5", "\u03b5"}, {"\u03f7", "\u03f8"}, {"\u03f9", "\u03f2"},
+      {"\u03fa", "\u03fb"}, {"\u03fd", "\u037b"}, {"\u03ff", "\u037d"},
+      {"\u0460", "\u0461"}, {"\u0480", "\u0481"}, {"\u048a", "\u048b"},
+      {"\u0490", "\u0491"}, {"\u04be", "\u04bf"}, {"\u04c0", "\u04cf"},
+      {"\u04c1", "\u04c2"}, {"\u04cd", "\u04ce"}, {"\u04d0", "\u04d1"},
+      {"\u0500", "\u0501"}, {"\u052e", "\u052f"}, {"\u0461", "\u0461"},
+      {"\u04cf", "\u04cf"}, {"\u052f", "\u052f"}, {"\u0530", "\u0530"},
+  };
+  std::string all;
+  std::string all_folded;
+  for (const auto& [upper, lower] : folds) {
+    EXPECT_TRUE(String(upper.data()).FoldCase() == lower.data()) << upper;
+    all += upper + " ";
+    all_folded += lower + " ";
+  }
+  EXPECT_TRUE(String(all.data()).FoldCase() == all_folded.data());
+}
+
+TEST(Numbers, ParseInt) {
+  int64_t value = 0;
+  EXPECT_TRUE(String("-9223372036854775808").ParseInt(&value));
+  EXPECT_EQ(value, INT64_MIN);
+  int small = 7;
+  EXPECT_TRUE(String("-123").ParseInt(&small));
+  EXPECT_EQ(small, -123);
+  EXPECT_FALSE(String("2147483648").ParseInt(&small));
+  EXPECT_FALSE(String("").ParseInt(&small));
+  EXPECT_FALSE(String("+1").ParseInt(&small));
+  EXPECT_FALSE(String("12 ").ParseInt(&small));
+  EXPECT_FALSE(String("1.5").ParseInt(&small));
+  EXPECT_EQ(small, -123);
+  uint8_t byte = 0;
+  EXPECT_TRUE(String("255").ParseInt(&byte));
+  EXPECT_EQ(byte, 255);
+  EXPECT_FALSE(String("-1").ParseInt(&byte));
+  EXPECT_FALSE(String("256").ParseInt(&byte));
+}
+
+template <typename T>
+concept ParsesAsInt = requires(const String& text, T* value) {
+  text.ParseInt(value);
+};
+
+template <typename T>
+concept AppendsAsNumber = requires(String& text, T value) {
+  text.AppendNumber(value);
+};
+
+TEST(Numbers, OnlyNumericIntegers) {
+  static_assert(ParsesAsInt<int8_t> && ParsesAsInt<uint64_t>);
+  static_assert(!ParsesAsInt<bool> && !ParsesAsInt<char>);
+  static_assert(!ParsesAsInt<char8_t> && !ParsesAsInt<char32_t>);
+  static_assert(AppendsAsNumber<int16_t> && AppendsAsNumber<float>);
+  static_assert(!AppendsAsNumber<bool> && !AppendsAsNumber<char>);
+  static_assert(!AppendsAsNumber<wchar_t> && !AppendsAsNumber<char16_t>);
+}
+
+TEST(Numbers, ParseDouble) {
+  double value = 0;
+  EXPECT_TRUE(String("-1.5e3").ParseDouble(&value));
+  EXPECT_EQ(value, -1500.0);
+  EXPECT_TRUE(String("0.1").ParseDouble(&value));
+  EXPECT_EQ(value, 0.1);
+  EXPECT_FALSE(String("1e").ParseDouble(&value));
+  EXPECT_FALSE(String("abc").ParseDouble(&value));
+  EXPECT_FALSE(String("1e-400").ParseDouble(&value));
+  EXPECT_FALSE(String("1e400").ParseDouble(&value));
+  EXPECT_EQ(value, 0.1);
+  EXPECT_TRUE(String("4.9e-324").ParseDouble(&value));
+  EXPECT_EQ(value, std::numeric_limits<double>::denorm_min());
+}
+
+TEST(Numbers, ParseDoubleIgnoresLocale) {
+  const char* comma_locales[] = {"de_DE.UTF-8", "fr_FR.UTF-8", "ru_RU.UTF-8"};
+  std::string previous = std::setlocale(LC_NUMERIC, nullptr);
+  const char* found = nullptr;
+  for (const char* name : comma_locales) {
+    found = found != nullptr ? found : std::setlocale(LC_NUMERIC, name);
+  }
+  if (found == nullptr) {
+    GTEST_SKIP() << "no locale with a decimal comma installed";
+  }
+  double value = 0;
+  EXPECT_TRUE(String("4.9e-324").ParseDouble(&value));
+  EXPECT_EQ(value, std::numeric_limits<double>::denorm_min());
+  EXPECT_TRUE(String("1.5e-310").ParseDouble(&value));
+  EXPECT_EQ(value, 1.5e-310);
+  EXPECT_FALSE(String("4,9e-324").ParseDouble(&value));
+  std::setlocale(LC_NUMERIC, previous.data());
+}
+
+TEST(Numbers, AppendNumber) {
+  String text("x=");
+  text.AppendNumber(-42).Append(", ").AppendNumber(UINT64_MAX);
+  EXPECT_TRUE(text == "x=-42, 18446744073709551615");
+  EXPECT_TRUE(String().AppendNumber(0.1) == "0.1");
+  EXPECT_TRUE(String().AppendNumber(1e100) == "1e+100");
+  EXPECT_TRUE(String().AppendNumber(-0.0) == "-0");
+}
+
+TEST(Numbers, DoublesRoundTrip) {
+  std::mt19937_64 gen(42);
+  for (int i = 0; i < 100000; ++i) {
+    uint64_t bits = gen();
+    double value = 0;
+    std::memcpy(&value, &bits, sizeof(value));
+    if (value != value) {
+      continue;
+    }
+    String text;
+    text.AppendNumber(value);
+    double parsed = 0;
+    ASSERT_TRUE(text.ParseDouble(&parsed)) << text;
+    ASSERT_EQ(parsed, value) << text;
+    std::ostringstream stream;
+    stream.precision(17);
+    stream << value;
+    ASSERT_LE(text.Size(), stream.str().size()) << text;
+  }
+}
+
 TEST(Join, Easy) {
   EXPECT_TRUE(String("aba") == String("b").Join({"a", "a"}));
 }
@@ -421,6 +1230,23 @@ TEST(Join, Empty) {
   EXPECT_TRUE(String(" ") == String("").Join({" "}));
 }
 
+TEST(Join, ExactSize) {
+  std::vector<String> words{String(30, 'a'), String(40, 'b'), "c"};
+  String joined = String(", ").Join(words);
+  EXPECT_EQ(joined.Size(), 75);
+  EXPECT_EQ(joined.Capacity(), 75);
+  EXPECT_TRUE(joined == String(30, 'a') + ", " + String(40, 'b') + ", c");
+}
+
+TEST(Join, Ranges) {
+  const char* words[] = {"ts=1", "lvl=info", "host=web-17"};
+  EXPECT_TRUE(String(" ").Join(words) == "ts=1 lvl=info host=web-17");
+  EXPECT_TRUE(String("|").Join(words + 1, words + 3) == "lvl=info|host=web-17");
+
+  String line = "a, b, , c";
+  EXPECT_TRUE(String(";").Join(line.SplitView(", ")) == "a;b;;c");
+}
+
 TEST(Join, Stress) {
   String a = String("a") * 133700;
   String b = String("b") * 198400;